@@ -2,9 +2,9 @@
 
 // Optional: Define memory optimization mode before including LoRaMesh
 // Uncomment one of the following lines based on your memory requirements:
-// #define LORAMESH_MEMORY_CONSTRAINED  // Use minimal memory (~732 bytes)
-// #define LORAMESH_HIGH_CAPACITY       // Use more memory for better performance (~2,912 bytes)
-// Default (standard mode): ~1,438 bytes
+// #define LORAMESH_MEMORY_CONSTRAINED  // Use minimal memory (~1,708 bytes)
+// #define LORAMESH_HIGH_CAPACITY       // Use more memory for better performance (~6,128 bytes)
+// Default (standard mode): ~2,768 bytes
 
 #include <LoRaMesh.h>
 
@@ -29,9 +29,9 @@ void setup() {
   Serial.println(myAddress, HEX);
   
   // Memory optimization modes:
-  // - Standard mode (default): ~1,438 bytes
-  // - Memory-constrained mode: ~732 bytes (define LORAMESH_MEMORY_CONSTRAINED)
-  // - High-capacity mode: ~2,912 bytes (define LORAMESH_HIGH_CAPACITY)
+  // - Standard mode (default): ~2,768 bytes
+  // - Memory-constrained mode: ~1,708 bytes (define LORAMESH_MEMORY_CONSTRAINED)
+  // - High-capacity mode: ~6,128 bytes (define LORAMESH_HIGH_CAPACITY)
   
   // Configure LoRa pins before initializing mesh
   mesh.setPins(csPin, resetPin, irqPin);
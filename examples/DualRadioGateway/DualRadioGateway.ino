@@ -0,0 +1,76 @@
+#include <SPI.h>
+#include <LoRaMesh.h>
+
+// Two SX127x modules on one SPI bus, each listening on its own channel
+const int csPin1 = 7;
+const int resetPin1 = 6;
+const int irqPin1 = 1;
+
+const int csPin2 = 10;
+const int resetPin2 = 9;
+const int irqPin2 = 2;
+
+LoRaClass radio2;
+
+LoRaMesh mesh1;          // Global LoRa object: discovery and data
+LoRaMesh mesh2(radio2);  // Second module: data only, never flooded by the gateway
+LoRaMeshBridge bridge;
+
+uint8_t gatewayAddress = 0x01;
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+  
+  Serial.println("LoRa Mesh Dual-Radio Gateway");
+  
+  mesh1.setPins(csPin1, resetPin1, irqPin1);
+  mesh2.setPins(csPin2, resetPin2, irqPin2);
+  
+  // Both instances share the gateway address
+  if (!mesh1.begin(868.1E6, gatewayAddress) || !mesh2.begin(868.5E6, gatewayAddress)) {
+    Serial.println("Starting LoRa Mesh failed!");
+    while (1);
+  }
+  
+  bridge.addRadio(mesh1);
+  bridge.addRadio(mesh2, LORAMESH_RADIO_DATA);
+  
+  Serial.print("Radios: ");
+  Serial.println(bridge.getRadioCount());
+  Serial.println("Bridging mesh traffic between channels...");
+}
+
+void loop() {
+  uint8_t buf[LORAMESH_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+  uint8_t source, dest, id, radio;
+  
+  if (bridge.recvFromAck(buf, &len, &source, &dest, &id, &radio)) {
+    Serial.print("Radio ");
+    Serial.print(radio);
+    Serial.print(" from 0x");
+    Serial.print(source, HEX);
+    Serial.print(": ");
+    for (int i = 0; i < len; i++) {
+      Serial.print((char)buf[i]);
+    }
+    Serial.println();
+    
+    if (dest == gatewayAddress) {
+      String response = "ACK from gateway at " + String(millis());
+      bridge.sendToWait(source, (uint8_t*)response.c_str(), response.length());
+    }
+  }
+  
+  bridge.process();
+  
+  static unsigned long lastStatusPrint = 0;
+  if (millis() - lastStatusPrint > 20000) {
+    Serial.println("\n=== Channel 1 routes ===");
+    mesh1.printRoutingTable();
+    Serial.println("=== Channel 2 routes ===");
+    mesh2.printRoutingTable();
+    lastStatusPrint = millis();
+  }
+}
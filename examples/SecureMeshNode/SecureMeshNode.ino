@@ -0,0 +1,129 @@
+#include <SPI.h>
+#include <LoRaMesh.h>
+#include <EEPROM.h>
+
+const int csPin = 7;
+const int resetPin = 6;
+const int irqPin = 1;
+
+LoRaMesh mesh;
+
+uint8_t myAddress = 0x01;
+uint8_t destinationAddress = 0x03;
+
+// Shared by every node in the mesh - replace with your own random key
+const uint8_t networkKey[LORAMESH_KEY_LEN] = {
+  0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+  0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+};
+
+unsigned long lastSendTime = 0;
+int sendInterval = 10000;
+
+void setup() {
+  Serial.begin(9600);
+  while (!Serial);
+  
+  Serial.println("Secure LoRa Mesh Node");
+  Serial.print("My address: 0x");
+  Serial.println(myAddress, HEX);
+  
+  benchmarkCipher();
+  
+  // Configure LoRa pins before initializing mesh
+  mesh.setPins(csPin, resetPin, irqPin);
+  
+  // The frame counter must survive resets, or nonces would repeat under the key
+  mesh.setPersistence(
+    [](uint16_t address) { return EEPROM.read(address); },
+    [](uint16_t address, uint8_t value) { EEPROM.update(address, value); });
+  
+  if (!mesh.begin(915E6, myAddress)) {
+    Serial.println("Starting LoRa Mesh failed!");
+    while (1);
+  }
+  
+  // All frames are sealed with AES-CCM from here on; unsecured frames are dropped
+  if (!mesh.setNetworkKey(networkKey)) {
+    Serial.println("Setting the network key failed!");
+    while (1);
+  }
+  
+  Serial.println("LoRa Mesh init succeeded.");
+}
+
+void loop() {
+  if (millis() - lastSendTime > sendInterval) {
+    String message = "Secret from node 0x" + String(myAddress, HEX) + " at " + String(millis());
+    
+    Serial.print("Sending to 0x");
+    Serial.print(destinationAddress, HEX);
+    Serial.print(": ");
+    Serial.println(message);
+    
+    if (mesh.sendToWait(destinationAddress, (uint8_t*)message.c_str(), message.length())) {
+      Serial.println("Message sent successfully");
+    } else {
+      Serial.println("Failed to send message");
+    }
+    
+    lastSendTime = millis();
+  }
+  
+  uint8_t buf[LORAMESH_MAX_MESSAGE_LEN];
+  uint8_t len = sizeof(buf);
+  uint8_t source, dest, id;
+  
+  if (mesh.recvFromAck(buf, &len, &source, &dest, &id)) {
+    Serial.println("=== Received Authenticated Message ===");
+    Serial.print("From: 0x");
+    Serial.println(source, HEX);
+    Serial.print("Message: ");
+    for (int i = 0; i < len; i++) {
+      Serial.print((char)buf[i]);
+    }
+    Serial.println();
+    Serial.println("====================");
+  }
+  
+  mesh.process();
+}
+
+// Measure the per-frame cost of sealing and opening a payload
+void benchmarkCipher() {
+  const int iterations = 20;
+  const uint8_t sizes[] = {16, 64, 200};
+  
+  LoRaMeshCipher cipher;
+  uint8_t nonce[LORAMESH_NONCE_LEN] = {0};
+  uint8_t header[10] = {0};
+  uint8_t payload[200] = {0};
+  uint8_t tag[LORAMESH_TAG_LEN];
+  
+  unsigned long start = micros();
+  cipher.setKey(networkKey);
+  Serial.print("Key schedule: ");
+  Serial.print(micros() - start);
+  Serial.println(" us (once)");
+  
+  for (uint8_t s = 0; s < sizeof(sizes); s++) {
+    start = micros();
+    for (int i = 0; i < iterations; i++) {
+      cipher.seal(nonce, header, sizeof(header), payload, sizes[s], tag);
+    }
+    unsigned long sealTime = (micros() - start) / iterations;
+    
+    start = micros();
+    for (int i = 0; i < iterations; i++) {
+      cipher.open(nonce, header, sizeof(header), payload, sizes[s], tag);
+    }
+    unsigned long openTime = (micros() - start) / iterations;
+    
+    Serial.print(sizes[s]);
+    Serial.print(" byte payload: seal ");
+    Serial.print(sealTime);
+    Serial.print(" us, open ");
+    Serial.print(openTime);
+    Serial.println(" us");
+  }
+}
@@ -0,0 +1,67 @@
+-- Wireshark dissector for pcap files written by loramesh_trace.py (link type USER0).
+-- Copy into the personal plugins folder (Help > About Wireshark > Folders).
+
+local loramesh = Proto("loramesh_trace", "LoRaMesh Trace")
+
+local events = {
+    [0x01] = "TX", [0x02] = "RX", [0x03] = "DROP", [0x04] = "ACK", [0x05] = "RETRY",
+    [0x06] = "ACK_TIMEOUT", [0x07] = "DISCOVERY_START", [0x08] = "DISCOVERY_DONE",
+    [0x09] = "DISCOVERY_FAIL", [0x0A] = "CONGESTION"
+}
+local types = {
+    [0x00] = "DATA", [0x01] = "ROUTE_REQUEST", [0x02] = "ROUTE_REPLY",
+    [0x03] = "ROUTE_FAILURE", [0x04] = "ACK", [0x05] = "RECEIPT",
+    [0x06] = "GROUP_REPORT", [0x07] = "MULTICAST", [0x08] = "SUMMARY",
+    [0x09] = "CHUNK_REQUEST", [0x0A] = "CHUNK", [0x0B] = "POSITION", [0x0C] = "GEO_DATA"
+}
+
+local f = loramesh.fields
+f.node = ProtoField.uint8("loramesh.node", "Node", base.HEX)
+f.time = ProtoField.uint32("loramesh.time", "Uptime (ms)")
+f.event = ProtoField.uint8("loramesh.event", "Event", base.HEX, events)
+f.destination = ProtoField.uint8("loramesh.dst", "Destination", base.HEX)
+f.source = ProtoField.uint8("loramesh.src", "Source", base.HEX)
+f.message_id = ProtoField.uint8("loramesh.id", "Message ID")
+f.type = ProtoField.uint8("loramesh.type", "Message type", base.HEX, types, 0x1F)
+f.secure = ProtoField.bool("loramesh.flags.secure", "Secure", 8, nil, 0x80)
+f.receipt = ProtoField.bool("loramesh.flags.receipt", "Receipt requested", 8, nil, 0x40)
+f.source_route = ProtoField.bool("loramesh.flags.source_route", "Source routed", 8, nil, 0x20)
+f.hop_count = ProtoField.uint8("loramesh.hops", "Hop count")
+f.next_hop = ProtoField.uint8("loramesh.next_hop", "Next hop", base.HEX)
+f.length = ProtoField.uint8("loramesh.len", "Frame length")
+f.rssi = ProtoField.int8("loramesh.rssi", "RSSI (dBm)")
+f.snr = ProtoField.int8("loramesh.snr", "SNR (0.25 dB)")
+f.arg = ProtoField.uint8("loramesh.arg", "Argument")
+
+function loramesh.dissector(buffer, pinfo, tree)
+    if buffer:len() < 17 then return 0 end
+    pinfo.cols.protocol = "LoRaMesh"
+
+    local event = buffer(5, 1):uint()
+    local kind = types[bit.band(buffer(9, 1):uint(), 0x1F)] or "?"
+    pinfo.cols.src = string.format("%02x", buffer(7, 1):uint())
+    pinfo.cols.dst = string.format("%02x", buffer(6, 1):uint())
+    pinfo.cols.info = string.format("node %02x %s %s id %d hop %d",
+        buffer(0, 1):uint(), events[event] or "?", kind, buffer(8, 1):uint(), buffer(10, 1):uint())
+
+    local subtree = tree:add(loramesh, buffer(0, 17))
+    subtree:add(f.node, buffer(0, 1))
+    subtree:add_le(f.time, buffer(1, 4))
+    subtree:add(f.event, buffer(5, 1))
+    subtree:add(f.destination, buffer(6, 1))
+    subtree:add(f.source, buffer(7, 1))
+    subtree:add(f.message_id, buffer(8, 1))
+    subtree:add(f.type, buffer(9, 1))
+    subtree:add(f.secure, buffer(9, 1))
+    subtree:add(f.receipt, buffer(9, 1))
+    subtree:add(f.source_route, buffer(9, 1))
+    subtree:add(f.hop_count, buffer(10, 1))
+    subtree:add(f.next_hop, buffer(11, 1))
+    subtree:add(f.length, buffer(12, 1))
+    subtree:add(f.rssi, buffer(13, 1))
+    subtree:add(f.snr, buffer(14, 1))
+    subtree:add(f.arg, buffer(15, 1))
+    return 17
+end
+
+DissectorTable.get("wtap_encap"):add(wtap.USER0, loramesh)
@@ -0,0 +1,192 @@
+#!/usr/bin/env python3
+"""Decode LoRaMesh trace dumps written by dumpTrace().
+
+Captures are raw bytes: a serial log (text and dumps may be interleaved), a
+file written on an SD card, or stdin ("-"). Every dump starts with "LMTR".
+
+    loramesh_trace.py capture.bin                 # one line per event
+    loramesh_trace.py --stats node*.bin           # hop latency, retransmissions, frames sent
+    loramesh_trace.py -w mesh.pcap node*.bin      # for Wireshark with loramesh_trace.lua
+    loramesh_trace.py --align -w mesh.pcap a.bin b.bin
+
+Timestamps are node uptime in ms. --align shifts each capture so that its last
+dump lines up with the others, for captures read off several nodes together.
+"""
+
+import argparse
+import struct
+import sys
+
+MAGIC = b"LMTR"
+VERSION = 1
+HEADER = struct.Struct("<4sBBBBHI")
+RECORD = struct.Struct("<IBBBBBBBBbbBB")
+LINKTYPE_USER0 = 147
+
+EVENTS = {
+    0x01: "TX", 0x02: "RX", 0x03: "DROP", 0x04: "ACK", 0x05: "RETRY",
+    0x06: "ACK_TIMEOUT", 0x07: "DISC_START", 0x08: "DISC_DONE", 0x09: "DISC_FAIL",
+    0x0A: "CONGESTION",
+}
+TYPES = {0: "DATA", 1: "RREQ", 2: "RREP", 3: "RERR", 4: "ACK", 5: "RCPT", 6: "GREP", 7: "MCAST",
+         8: "SUM", 9: "CREQ", 10: "CHUNK", 11: "POS", 12: "GEO"}
+FLAGS = ((0x80, "SEC"), (0x40, "RCPT"), (0x20, "SR"))
+DROP_REASONS = {1: "auth", 2: "unsecured", 3: "congested"}
+
+
+class Record:
+    def __init__(self, node, fields):
+        (self.time, self.event, self.destination, self.source, self.message_id,
+         self.type, self.hop_count, self.next_hop, self.length, self.rssi,
+         self.snr, self.arg, _) = fields
+        self.node = node
+
+    def raw(self):
+        return RECORD.pack(self.time, self.event, self.destination, self.source,
+                           self.message_id, self.type, self.hop_count, self.next_hop,
+                           self.length, self.rssi, self.snr, self.arg, 0)
+
+    def type_name(self):
+        name = TYPES.get(self.type & 0x1F, "0x%02x" % (self.type & 0x1F))
+        return "|".join([name] + [f for bit, f in FLAGS if self.type & bit])
+
+
+def parse(data, name):
+    """Yield (address, dump time, lost, records) for every dump in data."""
+    pos = data.find(MAGIC)
+    while pos >= 0:
+        if pos + HEADER.size > len(data):
+            break
+        _, version, address, count, record_len, lost, dump_time = HEADER.unpack_from(data, pos)
+        end = pos + HEADER.size + count * record_len
+        if version != VERSION or record_len < RECORD.size or end > len(data):
+            sys.stderr.write("%s: skipping damaged dump at byte %d\n" % (name, pos))
+            pos = data.find(MAGIC, pos + 1)
+            continue
+        records = []
+        for i in range(count):
+            offset = pos + HEADER.size + i * record_len
+            records.append(Record(address, RECORD.unpack_from(data, offset)))
+        yield address, dump_time, lost, records
+        pos = data.find(MAGIC, end)
+
+
+def load(paths, align):
+    captures = []
+    for path in paths:
+        data = sys.stdin.buffer.read() if path == "-" else open(path, "rb").read()
+        dumps = list(parse(data, path))
+        if dumps:
+            captures.append(dumps)
+        else:
+            sys.stderr.write("%s: no trace dumps found\n" % path)
+
+    # Offset per capture so last dumps coincide with the latest one
+    latest = max([c[-1][1] for c in captures] or [0])
+    records = []
+    for dumps in captures:
+        shift = latest - dumps[-1][1] if align else 0
+        for address, _, lost, dump_records in dumps:
+            if lost:
+                sys.stderr.write("node 0x%02x: %d records overwritten before a dump\n" % (address, lost))
+            for record in dump_records:
+                record.time += shift
+                records.append(record)
+    records.sort(key=lambda r: r.time)
+    return records
+
+
+def describe(r):
+    line = "%10.3f  %02x %-11s %-12s %02x->%02x id %3d hop %d" % (
+        r.time / 1000.0, r.node, EVENTS.get(r.event, "0x%02x" % r.event),
+        r.type_name(), r.source, r.destination, r.message_id, r.hop_count)
+    if r.next_hop != 0xFF:
+        line += " via %02x" % r.next_hop
+    if r.length:
+        line += " len %d" % r.length
+    if r.event in (0x02, 0x03):
+        line += " rssi %d snr %.2f" % (r.rssi, r.snr / 4.0)
+    if r.event == 0x03:
+        line += " (%s)" % DROP_REASONS.get(r.arg, r.arg)
+    elif r.event in (0x04, 0x05, 0x08):
+        line += " arg %d" % r.arg
+    elif r.event == 0x0A:
+        line += " (%s)" % {1: "busy", 2: "full"}.get(r.arg, r.arg)
+    return line
+
+
+def stats(records):
+    # Per node and next hop: acknowledged-frame attempts, retries, timeouts and
+    # first-TX-to-ACK latency
+    links = {}
+    first_tx = {}
+    retries_by_node = {}
+    sent = {}
+    for r in records:
+        if r.event == 0x01:
+            sent[r.type & 0x1F] = sent.get(r.type & 0x1F, 0) + 1
+        link = links.setdefault((r.node, r.next_hop), {"tx": 0, "retry": 0, "timeout": 0, "latency": []})
+        key = (r.node, r.next_hop, r.source, r.message_id, r.type & 0x1F)
+        if r.event == 0x01 and r.next_hop != 0xFF and (r.type & 0x1F) != 0x04:
+            link["tx"] += 1
+            first_tx.setdefault(key, r.time)
+        elif r.event == 0x05:
+            link["retry"] += 1
+            retries_by_node.setdefault(r.node, []).append(r.time)
+        elif r.event == 0x06:
+            link["timeout"] += 1
+            first_tx.pop(key, None)
+        elif r.event == 0x04 and key in first_tx:
+            link["latency"].append(r.time - first_tx.pop(key))
+
+    print("node  next  tx  retry  timeout  hop latency ms (min/avg/max)")
+    for (node, next_hop), link in sorted(links.items()):
+        if not link["tx"]:
+            continue
+        latency = link["latency"]
+        summary = "%d/%d/%d" % (min(latency), sum(latency) // len(latency), max(latency)) if latency else "-"
+        print("  %02x    %02x %4d  %5d  %7d  %s" % (node, next_hop, link["tx"], link["retry"], link["timeout"], summary))
+
+    # Densest one-second burst of retransmissions per node
+    for node, times in sorted(retries_by_node.items()):
+        burst, start = 0, 0
+        for end in range(len(times)):
+            while times[end] - times[start] >= 1000:
+                start += 1
+            burst = max(burst, end - start + 1)
+        print("node %02x: %d retries, at most %d within one second" % (node, len(times), burst))
+
+    # Total transmissions, e.g. to compare dissemination cost across mesh sizes
+    print("frames sent: %d (%s)" % (sum(sent.values()), ", ".join(
+        "%s %d" % (TYPES.get(t, "0x%02x" % t), n) for t, n in sorted(sent.items()))))
+
+
+def write_pcap(path, records):
+    with open(path, "wb") as out:
+        out.write(struct.pack("<IHHiIII", 0xA1B2C3D4, 2, 4, 0, 0, 65535, LINKTYPE_USER0))
+        for r in records:
+            packet = bytes([r.node]) + r.raw()
+            out.write(struct.pack("<IIII", r.time // 1000, (r.time % 1000) * 1000, len(packet), len(packet)))
+            out.write(packet)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode LoRaMesh trace dumps")
+    parser.add_argument("captures", nargs="+", help="raw capture files, - for stdin")
+    parser.add_argument("-w", "--pcap", help="write a pcap file (link type USER0)")
+    parser.add_argument("--stats", action="store_true", help="print per-link latency, retransmission and frame count summary")
+    parser.add_argument("--align", action="store_true", help="line up the last dump of every capture")
+    args = parser.parse_args()
+
+    records = load(args.captures, args.align)
+    if args.pcap:
+        write_pcap(args.pcap, records)
+    if args.stats:
+        stats(records)
+    elif not args.pcap:
+        for r in records:
+            print(describe(r))
+
+
+if __name__ == "__main__":
+    main()
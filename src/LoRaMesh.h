@@ -3,9 +3,11 @@
 
 #include <Arduino.h>
 #include <LoRa.h>
+#include "LoRaMeshCrypto.h"
 
 // Message and buffer configuration
 #define LORAMESH_MAX_MESSAGE_LEN 251
+#define LORAMESH_MAX_FRAME_LEN 255      // SX127x FIFO limit for a single frame
 
 // Configurable buffer sizes - users can override these before including the library
 #ifndef LORAMESH_MESSAGE_BUFFER_SIZE
@@ -24,16 +26,74 @@
 #define LORAMESH_MAX_HOPS 8             // Default maximum hop count
 #endif
 
+#ifndef LORAMESH_NEIGHBOR_TABLE_SIZE
+#define LORAMESH_NEIGHBOR_TABLE_SIZE 6  // Default number of tracked one-hop links
+#endif
+
+#ifndef LORAMESH_LINK_KEY_TABLE_SIZE
+#define LORAMESH_LINK_KEY_TABLE_SIZE 2  // Default number of per-link keys
+#endif
+
+#ifndef LORAMESH_REPLAY_TABLE_SIZE
+#define LORAMESH_REPLAY_TABLE_SIZE 6    // Default number of sources with a replay window
+#endif
+
+#ifndef LORAMESH_OUTSTANDING_TABLE_SIZE
+#define LORAMESH_OUTSTANDING_TABLE_SIZE 4  // Default number of tracked originated messages
+#endif
+
+#ifndef LORAMESH_RECEIPT_QUEUE_SIZE
+#define LORAMESH_RECEIPT_QUEUE_SIZE 2   // Default number of originators with receipts being aggregated
+#endif
+
+#ifndef LORAMESH_SOURCE_ROUTE_TABLE_SIZE
+#define LORAMESH_SOURCE_ROUTE_TABLE_SIZE 2  // Default number of cached source-route paths
+#endif
+
+#ifndef LORAMESH_GROUP_MEMBER_TABLE_SIZE
+#define LORAMESH_GROUP_MEMBER_TABLE_SIZE 8  // Default number of known multicast group members
+#endif
+
+#ifndef LORAMESH_MAX_CHUNKS
+#define LORAMESH_MAX_CHUNKS 32          // Default chunks in a disseminated object (4 KB)
+#endif
+
+#ifndef LORAMESH_POSITION_TABLE_SIZE
+#define LORAMESH_POSITION_TABLE_SIZE 8  // Default number of known node positions
+#endif
+
+#ifndef LORAMESH_TRACE_BUFFER_SIZE
+#define LORAMESH_TRACE_BUFFER_SIZE 0    // Default number of trace records; 0 compiles tracing out
+#endif
+
 // Memory-constrained mode - define this to use minimal memory settings
 #ifdef LORAMESH_MEMORY_CONSTRAINED
 #undef LORAMESH_MESSAGE_BUFFER_SIZE
 #undef LORAMESH_PENDING_QUEUE_SIZE
 #undef LORAMESH_ROUTING_TABLE_SIZE
 #undef LORAMESH_MAX_HOPS
+#undef LORAMESH_NEIGHBOR_TABLE_SIZE
+#undef LORAMESH_LINK_KEY_TABLE_SIZE
+#undef LORAMESH_REPLAY_TABLE_SIZE
+#undef LORAMESH_OUTSTANDING_TABLE_SIZE
+#undef LORAMESH_RECEIPT_QUEUE_SIZE
+#undef LORAMESH_SOURCE_ROUTE_TABLE_SIZE
+#undef LORAMESH_GROUP_MEMBER_TABLE_SIZE
+#undef LORAMESH_MAX_CHUNKS
+#undef LORAMESH_POSITION_TABLE_SIZE
 #define LORAMESH_MESSAGE_BUFFER_SIZE 2
 #define LORAMESH_PENDING_QUEUE_SIZE 1
 #define LORAMESH_ROUTING_TABLE_SIZE 5
 #define LORAMESH_MAX_HOPS 6
+#define LORAMESH_NEIGHBOR_TABLE_SIZE 3
+#define LORAMESH_LINK_KEY_TABLE_SIZE 1
+#define LORAMESH_REPLAY_TABLE_SIZE 3
+#define LORAMESH_OUTSTANDING_TABLE_SIZE 2
+#define LORAMESH_RECEIPT_QUEUE_SIZE 1
+#define LORAMESH_SOURCE_ROUTE_TABLE_SIZE 1
+#define LORAMESH_GROUP_MEMBER_TABLE_SIZE 4
+#define LORAMESH_MAX_CHUNKS 8
+#define LORAMESH_POSITION_TABLE_SIZE 4
 #endif
 
 // High-capacity mode - define this for systems with more memory
@@ -42,10 +102,28 @@
 #undef LORAMESH_PENDING_QUEUE_SIZE
 #undef LORAMESH_ROUTING_TABLE_SIZE
 #undef LORAMESH_MAX_HOPS
+#undef LORAMESH_NEIGHBOR_TABLE_SIZE
+#undef LORAMESH_LINK_KEY_TABLE_SIZE
+#undef LORAMESH_REPLAY_TABLE_SIZE
+#undef LORAMESH_OUTSTANDING_TABLE_SIZE
+#undef LORAMESH_RECEIPT_QUEUE_SIZE
+#undef LORAMESH_SOURCE_ROUTE_TABLE_SIZE
+#undef LORAMESH_GROUP_MEMBER_TABLE_SIZE
+#undef LORAMESH_MAX_CHUNKS
+#undef LORAMESH_POSITION_TABLE_SIZE
 #define LORAMESH_MESSAGE_BUFFER_SIZE 8
 #define LORAMESH_PENDING_QUEUE_SIZE 5
 #define LORAMESH_ROUTING_TABLE_SIZE 15
 #define LORAMESH_MAX_HOPS 12
+#define LORAMESH_NEIGHBOR_TABLE_SIZE 12
+#define LORAMESH_LINK_KEY_TABLE_SIZE 4
+#define LORAMESH_REPLAY_TABLE_SIZE 12
+#define LORAMESH_OUTSTANDING_TABLE_SIZE 8
+#define LORAMESH_RECEIPT_QUEUE_SIZE 4
+#define LORAMESH_SOURCE_ROUTE_TABLE_SIZE 4
+#define LORAMESH_GROUP_MEMBER_TABLE_SIZE 24
+#define LORAMESH_MAX_CHUNKS 128
+#define LORAMESH_POSITION_TABLE_SIZE 16
 #endif
 
 // Fixed protocol constants
@@ -54,20 +132,119 @@
 #define LORAMESH_BROADCAST_ADDRESS 0xFF
 #define LORAMESH_ACK_TIMEOUT 300
 #define LORAMESH_MAX_ACK_RETRIES 3
+#define LORAMESH_REPLAY_WINDOW 32          // Sequence numbers tracked behind the highest seen
+#define LORAMESH_DUPLICATE_TIMEOUT 10000   // ms a quiet source's message IDs are remembered; covers retries and flood copies
+#define LORAMESH_RECEIPT_TIMEOUT 5000      // ms sendToWait waits for an end-to-end receipt
+#define LORAMESH_RECEIPT_DELAY 500         // ms a destination holds receipts to aggregate them
+#define LORAMESH_RECEIPT_BATCH 8           // Message IDs per receipt frame
+#define LORAMESH_SOURCE_ROUTE_TIMEOUT 120000  // Cached paths outlive relay table entries; failures evict them
+
+// Adaptive data rate (ADR) constants
+#define LORAMESH_ADR_MIN_TX_POWER 2        // dBm, lowest PA_BOOST setting
+#define LORAMESH_ADR_MAX_TX_POWER 17       // dBm, highest continuous PA_BOOST setting
+#define LORAMESH_ADR_POWER_STEP 2          // dB per controller step
+#define LORAMESH_ADR_SNR_MARGIN 5          // dB kept above the demodulation floor
+#define LORAMESH_ADR_TARGET_DELIVERY 7     // ACKs required out of the last 8 attempts
+#define LORAMESH_SUPPLY_VOLTAGE_MV 3300    // Used for energy accounting
+
+// Low-power listen (LPL) constants
+#define LORAMESH_LPL_CAD_TIMEOUT 20        // ms to wait for a channel activity detection result
+#define LORAMESH_LPL_GUARD_TIME 15         // ms of preamble kept on each side of a learned wake time
+#define LORAMESH_LPL_UNKNOWN_WAKE 0xFFFF   // Wake delay reported by nodes that never sleep
+#define LORAMESH_RX_CURRENT_UA 10800       // Receive / CAD supply current
+#define LORAMESH_SLEEP_CURRENT_UA 1        // Sleep supply current
+#define LORAMESH_LPL_RSSI_THRESHOLD -115   // dBm; energy detect on radios without a CAD interrupt
+#define LORAMESH_LPL_RSSI_SAMPLES 4        // RSSI reads, 1 ms apart, per channel sample
+
+// Warm-restart snapshot constants
+#define LORAMESH_SNAPSHOT_INTERVAL 10000   // ms between passes writing the tables to storage
+#define LORAMESH_SEQUENCE_LEASE 64         // Counter values reserved per storage write
+#define LORAMESH_SNAPSHOT_MAGIC 0x4D       // Marks an initialised snapshot
+#define LORAMESH_SNAPSHOT_VERSION 2
+#define LORAMESH_SNAPSHOT_HEADER_LEN 14    // magic, version, table sizes, address, two counter leases
+#define LORAMESH_SNAPSHOT_ROUTE_LEN 4      // destination, nextHop, hopCount, state
+#define LORAMESH_SNAPSHOT_NEIGHBOR_LEN 4   // address, txPower, codingRate, flags
+#define LORAMESH_SNAPSHOT_RESTORE_AGE (LORAMESH_ROUTE_TIMEOUT / 2000)  // s, age given to restored entries
+
+// Multi-radio gateway constants
+#ifndef LORAMESH_MAX_RADIOS
+#define LORAMESH_MAX_RADIOS 3              // Mesh instances one bridge can join
+#endif
+#define LORAMESH_RADIO_DATA 0x01           // Carries data bridged from other radios and sent by the gateway
+#define LORAMESH_RADIO_DISCOVERY 0x02      // Floods the gateway's route requests and answers for other radios
+
+// Multicast group constants
+#define LORAMESH_GROUP_BASE 0xF0           // Addresses 0xF0-0xFE are multicast groups, not nodes
+#define LORAMESH_GROUP_REFRESH 300000      // ms between membership reports from a member
+#define LORAMESH_GROUP_TIMEOUT 900000      // Members not reported for this long are forgotten
 
-// Memory usage estimates (with default settings):
-// - Standard mode (default): ~1,438 bytes  
-// - Memory-constrained mode: ~732 bytes (68% reduction)
-// - High-capacity mode: ~2,912 bytes
+// Dissemination (Trickle) constants
+#define LORAMESH_TRICKLE_IMIN 1000         // ms, shortest summary interval
+#define LORAMESH_TRICKLE_DOUBLINGS 8       // Longest interval is IMIN << DOUBLINGS (~4 min)
+#define LORAMESH_TRICKLE_K 1               // Consistent summaries heard that suppress our own
+#define LORAMESH_CHUNK_LEN 128             // Object bytes per chunk frame
+#define LORAMESH_CHUNK_REQUEST_INTERVAL 1500  // ms between requests while chunks are missing
+#define LORAMESH_CHUNK_SPACING 60          // ms, upper bound of the random gap before each chunk sent
+
+// Flow control constants
+#define LORAMESH_CONGESTION_NONE 0         // Congestion byte of a hop ACK: frame accepted, room to spare
+#define LORAMESH_CONGESTION_BUSY 1         // Accepted, but the queue is over half full
+#define LORAMESH_CONGESTION_FULL 2         // Refused; the sender keeps the frame and retries later
+#define LORAMESH_PACING_MIN 250            // ms between data frames to a neighbor after its first report
+#define LORAMESH_PACING_MAX 8000           // Pacing doubles per report up to this
+#define LORAMESH_PACING_RECOVERY 100       // ms of pacing removed per uncongested ACK
+#define LORAMESH_FORWARD_TIMEOUT 15000     // ms a relayed frame may wait in the pending queue
+
+// Geographic routing constants
+#define LORAMESH_POSITION_REFRESH 300000   // ms between position beacons
+#define LORAMESH_POSITION_TIMEOUT 900000   // Positions not refreshed for this long are forgotten
+#define LORAMESH_POSITION_JITTER 2000      // ms, upper bound of the random delay before an early beacon
+#define LORAMESH_GEO_OVERHEAD 16           // Destination and source coordinates ahead of the data
+
+// Trace capture constants; extras/loramesh_trace.py decodes dumps
+#define LORAMESH_TRACE_VERSION 1
+#define LORAMESH_TRACE_HEADER_LEN 14       // "LMTR", version, address, record count, record length, records lost, dump time
+#define LORAMESH_TRACE_RECORD_LEN 16
+
+// Memory usage, sizeof(LoRaMeshT<...>) on a 32-bit target, all features on / all off:
+// - Standard mode (default): ~2,768 / ~1,800 bytes
+// - Memory-constrained mode: ~1,708 / ~1,124 bytes (72% reduction)
+// - High-capacity mode: ~6,128 / ~4,296 bytes
+// Tables of features a policy disables take no space.
+// Each neighbor link entry adds 18 bytes, each replay window entry 24 bytes,
+// each outstanding send 11 bytes, each receipt aggregation slot 30 bytes,
+// the network key and each link key 176 bytes, each source-route path
+// LORAMESH_MAX_HOPS + 5 bytes, each group member 8 bytes, each trace record 16 bytes,
+// each known position 14 bytes, and dissemination LORAMESH_MAX_CHUNKS / 4 + 29
+// bytes plus the object buffer.
+// Pending-queue slots hold a full header, LORAMESH_MAX_HOPS + 5 bytes more than
+// a bare destination and message ID.
 
 enum MessageType {
     MESSAGE_TYPE_DATA = 0x00,
     MESSAGE_TYPE_ROUTE_REQUEST = 0x01,
     MESSAGE_TYPE_ROUTE_REPLY = 0x02,
     MESSAGE_TYPE_ROUTE_FAILURE = 0x03,
-    MESSAGE_TYPE_ACK = 0x04
+    MESSAGE_TYPE_ACK = 0x04,
+    MESSAGE_TYPE_RECEIPT = 0x05,
+    MESSAGE_TYPE_GROUP_REPORT = 0x06,
+    MESSAGE_TYPE_MULTICAST = 0x07,
+    MESSAGE_TYPE_SUMMARY = 0x08,
+    MESSAGE_TYPE_CHUNK_REQUEST = 0x09,
+    MESSAGE_TYPE_CHUNK = 0x0A,
+    MESSAGE_TYPE_POSITION = 0x0B,
+    MESSAGE_TYPE_GEO_DATA = 0x0C
 };
 
+// Flags carried in the upper bits of the message type byte
+#define MESSAGE_FLAG_SECURE 0x80    // Frame carries an AES-CCM trailer
+#define MESSAGE_FLAG_RECEIPT 0x40   // Originator wants an end-to-end receipt
+#define MESSAGE_FLAG_SOURCE_ROUTE 0x20  // visitedNodes holds the relay path chosen by the originator
+#define MESSAGE_FLAG_MASK 0xE0
+// 0x10 is still free, since types stop at 0x0C. Congestion is not marked there:
+// hop ACKs already report it, and backpressure reaches the originator hop by hop
+#define LORAMESH_SECURE_OVERHEAD (5 + LORAMESH_TAG_LEN)   // Transmitter, frame counter, tag
+
 enum RouteState {
     ROUTE_STATE_INVALID = 0x00,
     ROUTE_STATE_DISCOVERING = 0x01,
@@ -82,19 +259,291 @@ struct RoutingEntry {
     uint16_t lastSeenAge;  // Age in seconds instead of absolute timestamp (saves 2 bytes per entry)
 };
 
-struct MeshHeader {
+// Per-neighbor link state maintained by the adaptive data rate controller
+struct NeighborLink {
+    uint8_t address;
+    int8_t txPower;          // dBm used for frames sent to this neighbor
+    uint8_t codingRate;      // Coding rate denominator (5-8 for 4/5-4/8)
+    int8_t reportedSnr;      // SNR in dB the neighbor measured on our last frame
+    uint8_t ackHistory;      // One bit per recent attempt, 1 = ACK received
+    uint8_t valid : 1;       // Pack into single bit
+    uint8_t alwaysOn : 1;    // Neighbor reported that it never sleeps its radio
+    uint8_t reserved : 6;    // Reserved for future use
+    uint16_t lastSeenAge;    // Age in seconds instead of absolute timestamp
+    unsigned long wakeTime;  // millis() of a known wake window of this neighbor, 0 if unknown
+    uint16_t pacing;         // ms kept between data frames to this neighbor, 0 = not congested
+    unsigned long lastSendTime;  // millis() of our last data frame to this neighbor
+};
+
+enum DeliveryState {
+    DELIVERY_NONE = 0x00,        // Unknown message ID
+    DELIVERY_PENDING = 0x01,     // Waiting for a route or first-hop ACK
+    DELIVERY_FORWARDED = 0x02,   // First hop acknowledged the message
+    DELIVERY_CONFIRMED = 0x03,   // Destination sent an end-to-end receipt
+    DELIVERY_FAILED = 0x04       // No route or first hop never acknowledged
+};
+
+// Multicast group member learned from its membership report flood
+struct GroupMember {
+    uint8_t address;
+    uint8_t nextHop;         // Transmitter of the first report copy, 0xFF after a failed send
+    uint8_t hopCount;
+    uint8_t valid : 1;       // Pack into single bit
+    uint8_t reserved : 7;    // Reserved for future use
+    uint16_t groups;         // Bit n set = member of group LORAMESH_GROUP_BASE + n
+    uint16_t lastSeenAge;    // Age in seconds instead of absolute timestamp
+};
+
+// Node coordinates in a planar frame shared by the installation, e.g. metres
+// east and north of a survey point
+struct NodePosition {
+    uint8_t address;
+    uint8_t valid : 1;       // Pack into single bit
+    uint8_t neighbor : 1;    // Heard its position beacon directly
+    uint8_t fixed : 1;       // Set by the sketch; never expires
+    uint8_t failed : 1;      // Greedy forwarding towards it failed recently
+    uint8_t reserved : 4;    // Reserved for future use
+    int32_t x;
+    int32_t y;
+    uint16_t lastSeenAge;    // Age in seconds instead of absolute timestamp
+    uint16_t failureAge;     // Seconds since the failure, while failed is set
+};
+
+// Events recorded by the tracer
+enum TraceEvent {
+    TRACE_TX = 0x01,               // Frame handed to the radio
+    TRACE_RX = 0x02,               // Frame read from the radio, before any check
+    TRACE_DROP = 0x03,             // Received frame rejected; arg = TraceDropReason
+    TRACE_ACK = 0x04,              // Awaited hop ACK arrived; arg = attempt number
+    TRACE_RETRY = 0x05,            // Hop retransmission; arg = attempt number
+    TRACE_ACK_TIMEOUT = 0x06,      // Every attempt went unacknowledged
+    TRACE_DISCOVERY_START = 0x07,  // Route request flooded
+    TRACE_DISCOVERY_DONE = 0x08,   // Route reply received; arg = relays on the path
+    TRACE_DISCOVERY_FAIL = 0x09,   // No route before the discovery timeout
+    TRACE_CONGESTION = 0x0A        // Hop ACK reported congestion; arg = LORAMESH_CONGESTION_* state
+};
+
+enum TraceDropReason {
+    TRACE_DROP_AUTH = 0x01,        // Authentication or replay check failed
+    TRACE_DROP_UNSECURED = 0x02,   // Cleartext frame while a network key is set
+    TRACE_DROP_CONGESTED = 0x03    // Data frame refused with a full queue; the sender retries
+};
+
+// One trace record; frame fields are zero for events without a frame
+struct TraceRecord {
+    uint32_t time;           // millis() of the event
+    uint8_t event;           // TraceEvent
+    uint8_t destination;
+    uint8_t source;
+    uint8_t messageId;
+    uint8_t type;            // Message type and flags as sent on air
+    uint8_t hopCount;
+    uint8_t nextHop;
+    uint8_t length;          // Frame bytes on air
+    int8_t rssi;             // dBm, received frames only
+    int8_t snr;              // Quarter dB, received frames only
+    uint8_t arg;             // Event specific
+    uint8_t reserved;
+};
+
+// Trace ring buffer; the oldest record is overwritten when full
+template <uint8_t Size>
+struct LoRaMeshTrace {
+    TraceRecord records[Size];
+    uint8_t head;            // Oldest record
+    uint8_t count;
+    uint16_t lost;           // Records overwritten since the last dump
+    
+    LoRaMeshTrace() : head(0), count(0), lost(0) {}
+    
+    TraceRecord* add() {
+        uint8_t slot = (head + count) % Size;
+        if (count < Size) {
+            count++;
+        } else {
+            head = (head + 1) % Size;
+            if (lost < 0xFFFF) lost++;
+        }
+        return &records[slot];
+    }
+    TraceRecord* get(uint8_t index) { return &records[(head + index) % Size]; }
+    void clear() { head = 0; count = 0; lost = 0; }
+};
+
+// Tracing compiled out: no records and no bookkeeping
+template <>
+struct LoRaMeshTrace<0> {
+    static const uint8_t count = 0;
+    static const uint16_t lost = 0;
+    
+    TraceRecord* add() { return NULL; }
+    TraceRecord* get(uint8_t) { return NULL; }
+    void clear() {}
+};
+
+// Table storage, or one object with Size 1. Policies pass Size 0 for features
+// they compile out, so disabled tables cost no RAM
+template <class T, uint8_t Size>
+struct LoRaMeshTable {
+    static const uint8_t size = Size;
+    T entries[Size];
+    
+    T& operator[](uint8_t index) { return entries[index]; }
+    T* operator->() { return entries; }
+    T* data() { return entries; }
+};
+
+// Feature compiled out: loops bounded by size never run, and other accesses
+// sit behind the policy flag
+template <class T>
+struct LoRaMeshTable<T, 0> {
+    static const uint8_t size = 0;
+    
+    T& operator[](uint8_t) { return *data(); }
+    T* operator->() { return data(); }
+    T* data() { return NULL; }
+};
+
+// Originated message tracked until its first-hop ACK and end-to-end receipt
+struct OutstandingSend {
+    uint8_t destination;
+    uint8_t messageId;
+    uint8_t state;               // DeliveryState
+    unsigned long sendTime;      // millis() when sendToWait was called
+    unsigned long latency;       // Round trip to the receipt, excluding aggregation hold time
+};
+
+// Sliding replay window state for one source address
+struct ReplayEntry {
+    uint8_t address;
+    uint8_t valid : 1;          // Pack into single bit
+    uint8_t messageValid : 1;   // messageHighest/messageBitmap are in use
+    uint8_t frameValid : 1;     // frameHighest/frameBitmap are in use
+    uint8_t reserved : 5;       // Reserved for future use
+    unsigned long lastSeen;     // millis() of the last accepted ID or frame, also used for LRU eviction
+    uint32_t messageHighest;    // Extended message sequence, reconstructed from the 8-bit ID
+    uint32_t messageBitmap;     // Bit n set = messageHighest - n already seen
+    uint32_t frameHighest;      // Highest authenticated frame counter from this transmitter
+    uint32_t frameBitmap;
+};
+
+template <uint8_t MaxHops>
+struct MeshHeaderT {
     uint8_t destination;
     uint8_t source;
     uint8_t messageId;
     uint8_t messageType;
+    uint8_t flags;          // MESSAGE_FLAG_* bits, sent with the message type
     uint8_t hopCount;
     uint8_t visitedCount;
-    uint8_t visitedNodes[LORAMESH_MAX_HOPS];
+    uint8_t visitedNodes[MaxHops];
 };
 
-class LoRaMesh {
+typedef MeshHeaderT<LORAMESH_MAX_HOPS> MeshHeader;
+
+// Byte-addressed non-volatile storage (EEPROM, emulated EEPROM or flash) for snapshots
+typedef uint8_t (*LoRaMeshStorageRead)(uint16_t address);
+typedef void (*LoRaMeshStorageWrite)(uint16_t address, uint8_t value);
+typedef void (*LoRaMeshStorageCommit)();
+
+// CAD completes on DIO0; arduino-LoRa callbacks carry no context pointer and its
+// DIO0 interrupt only services the global LoRa object
+struct LoRaMeshCad {
+    static volatile uint8_t result;   // 0 = pending, 1 = clear, 2 = activity
+    static void onDone(bool detected);
+};
+
+// Compile-time configuration policies for LoRaMeshT. Table sizes bound every
+// loop and ring buffer index, so they fold into constants; a disabled feature
+// compiles its code paths out. Derive from a policy and shadow members to
+// customise an instance.
+struct LoRaMeshDefaultConfig {
+    static constexpr uint8_t messageBufferSize = LORAMESH_MESSAGE_BUFFER_SIZE;
+    static constexpr uint8_t pendingQueueSize = LORAMESH_PENDING_QUEUE_SIZE;
+    static constexpr uint8_t routingTableSize = LORAMESH_ROUTING_TABLE_SIZE;
+    static constexpr uint8_t maxHops = LORAMESH_MAX_HOPS;
+    static constexpr uint8_t neighborTableSize = LORAMESH_NEIGHBOR_TABLE_SIZE;
+    static constexpr uint8_t linkKeyTableSize = LORAMESH_LINK_KEY_TABLE_SIZE;
+    static constexpr uint8_t replayTableSize = LORAMESH_REPLAY_TABLE_SIZE;
+    static constexpr uint8_t outstandingTableSize = LORAMESH_OUTSTANDING_TABLE_SIZE;
+    static constexpr uint8_t receiptQueueSize = LORAMESH_RECEIPT_QUEUE_SIZE;
+    static constexpr uint8_t sourceRouteTableSize = LORAMESH_SOURCE_ROUTE_TABLE_SIZE;
+    static constexpr uint8_t groupMemberTableSize = LORAMESH_GROUP_MEMBER_TABLE_SIZE;
+    static constexpr uint8_t maxChunks = LORAMESH_MAX_CHUNKS;
+    static constexpr uint8_t positionTableSize = LORAMESH_POSITION_TABLE_SIZE;
+    static constexpr uint8_t traceBufferSize = LORAMESH_TRACE_BUFFER_SIZE;
+    
+    static constexpr bool adaptiveDataRate = true;
+    static constexpr bool lowPowerListen = true;
+    static constexpr bool security = true;
+    static constexpr bool deliveryReceipts = true;
+    static constexpr bool sourceRouting = true;
+    static constexpr bool persistentState = true;
+    static constexpr bool multicast = true;
+    static constexpr bool dissemination = true;
+    static constexpr bool flowControl = true;
+    static constexpr bool geographicRouting = true;
+};
+
+struct LoRaMeshMemoryConstrainedConfig : LoRaMeshDefaultConfig {
+    static constexpr uint8_t messageBufferSize = 2;
+    static constexpr uint8_t pendingQueueSize = 1;
+    static constexpr uint8_t routingTableSize = 5;
+    static constexpr uint8_t maxHops = 6;
+    static constexpr uint8_t neighborTableSize = 3;
+    static constexpr uint8_t linkKeyTableSize = 1;
+    static constexpr uint8_t replayTableSize = 3;
+    static constexpr uint8_t outstandingTableSize = 2;
+    static constexpr uint8_t receiptQueueSize = 1;
+    static constexpr uint8_t sourceRouteTableSize = 1;
+    static constexpr uint8_t groupMemberTableSize = 4;
+    static constexpr uint8_t maxChunks = 8;
+    static constexpr uint8_t positionTableSize = 4;
+};
+
+struct LoRaMeshHighCapacityConfig : LoRaMeshDefaultConfig {
+    static constexpr uint8_t messageBufferSize = 8;
+    static constexpr uint8_t pendingQueueSize = 5;
+    static constexpr uint8_t routingTableSize = 15;
+    static constexpr uint8_t maxHops = 12;
+    static constexpr uint8_t neighborTableSize = 12;
+    static constexpr uint8_t linkKeyTableSize = 4;
+    static constexpr uint8_t replayTableSize = 12;
+    static constexpr uint8_t outstandingTableSize = 8;
+    static constexpr uint8_t receiptQueueSize = 4;
+    static constexpr uint8_t sourceRouteTableSize = 4;
+    static constexpr uint8_t groupMemberTableSize = 24;
+    static constexpr uint8_t maxChunks = 128;
+    static constexpr uint8_t positionTableSize = 16;
+};
+
+template <class Config>
+class LoRaMeshBridgeT;
+
+template <class Config = LoRaMeshDefaultConfig>
+class LoRaMeshT {
+    static_assert(Config::messageBufferSize > 0 && Config::pendingQueueSize > 0 &&
+                  Config::routingTableSize > 0 && Config::neighborTableSize > 0 &&
+                  Config::linkKeyTableSize > 0 && Config::replayTableSize > 0 &&
+                  Config::outstandingTableSize > 0 && Config::receiptQueueSize > 0 &&
+                  Config::sourceRouteTableSize > 0 && Config::groupMemberTableSize > 0 &&
+                  Config::maxChunks > 0 && Config::positionTableSize > 0,
+                  "LoRaMesh tables need at least one entry");
+    static_assert(Config::maxHops > 0 &&
+                  8 + Config::maxHops + 1 + LORAMESH_SECURE_OVERHEAD <= LORAMESH_MAX_FRAME_LEN,
+                  "A route reply with maxHops + 1 visited nodes must fit the radio FIFO");
+    static_assert(8 + LORAMESH_RECEIPT_BATCH * 2 + LORAMESH_SECURE_OVERHEAD <= LORAMESH_MAX_FRAME_LEN,
+                  "A full receipt frame must fit the radio FIFO");
+    static_assert(9 + Config::maxHops + Config::groupMemberTableSize + LORAMESH_SECURE_OVERHEAD < LORAMESH_MAX_FRAME_LEN,
+                  "A multicast frame listing every known member must leave room for data");
+    static_assert(14 + LORAMESH_CHUNK_LEN + LORAMESH_SECURE_OVERHEAD <= LORAMESH_MAX_FRAME_LEN,
+                  "A chunk frame must fit the radio FIFO");
+    
 public:
-    LoRaMesh();
+    typedef MeshHeaderT<Config::maxHops> Header;
+    
+    // Binds to the given transceiver; one instance per radio on multi-radio gateways
+    LoRaMeshT(LoRaClass& radio = LoRa);
     
     bool begin(long frequency, uint8_t address);
     void setAddress(uint8_t address);
@@ -105,6 +554,8 @@ public:
     void setSPIFrequency(uint32_t frequency);
     
     bool sendToWait(uint8_t destination, const uint8_t* data, uint8_t len, uint8_t* flags = NULL);
+    // Longest unicast payload that fits a frame; broadcasts leave Config::maxHops bytes for the path
+    uint8_t getMaxMessageLen();
     bool recvFromAck(uint8_t* buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* flags = NULL);
     
     bool available();
@@ -117,24 +568,210 @@ public:
     void setRetries(uint8_t retries);
     void setRetryTimeout(uint16_t timeout);
     
+    // Base radio settings, used for broadcasts and for neighbors without ADR state
+    void setSpreadingFactor(int sf);
+    void setSignalBandwidth(long sbw);
+    void setCodingRate4(int denominator);
+    void setTxPower(int level);
+    
+    void setAdaptiveDataRate(bool enabled);
+    NeighborLink* getNeighborTable();
+    uint8_t getNeighborTableSize();
+    
+    unsigned long getTxAirtime();
+    unsigned long getDeliveredBytes();
+    unsigned long getEnergyPerDeliveredByte();
+    
+    // Duty-cycled receive: wake every interval ms and sample the channel with CAD
+    void setLowPowerListen(uint16_t wakeInterval, bool sleepRadio = true);
+    unsigned long getListenTime();
+    unsigned long getSleepTime();
+    unsigned long getDeliveredMessages();
+    unsigned long getEnergyPerDeliveredMessage();
+    
+    // End-to-end delivery receipts
+    void setDeliveryReceipts(bool enabled);
+    DeliveryState getDeliveryState(uint8_t messageId, unsigned long* latency = NULL);
+    uint8_t getLastMessageId();
+    
+    // Embed discovered paths in data frames so relays forward without table lookups
+    void setSourceRouting(bool enabled);
+    
+    // Authenticated encryption: keys are expanded once here, not per frame.
+    // Needs setPersistence() first so frame counters survive resets
+    bool setNetworkKey(const uint8_t* key);
+    bool setLinkKey(uint8_t neighbor, const uint8_t* key);
+    
+    // Warm restart: call before begin(), which restores the snapshot
+    void setPersistence(LoRaMeshStorageRead read, LoRaMeshStorageWrite write,
+                        uint16_t baseAddress = 0, LoRaMeshStorageCommit commit = NULL);
+    uint16_t getSnapshotSize();
+    
+    // Multicast groups LORAMESH_GROUP_BASE to 0xFE; sendToWait to a group
+    // reaches every member reported to this node
+    bool joinGroup(uint8_t group);
+    void leaveGroup(uint8_t group);
+    bool isGroupMember(uint8_t group);
+    uint8_t getGroupMembers(uint8_t group, uint8_t* members, uint8_t maxMembers);
+    uint8_t getMaxGroupMessageLen();
+    
+    // Epidemic dissemination of one versioned object, such as a settings block,
+    // to every node; the buffer holds the object and must outlive the mesh
+    void setDisseminationBuffer(uint8_t* buffer, uint16_t capacity);
+    bool disseminate(const uint8_t* data, uint16_t len);
+    bool disseminationUpdated(uint16_t* version = NULL, uint16_t* len = NULL);
+    uint16_t getDisseminationVersion();
+    
+    // Geographic routing for fixed installations: without a table route, data
+    // heads for the destination's position instead of flooding a route request
+    void setPosition(int32_t x, int32_t y);
+    bool setNodePosition(uint8_t address, int32_t x, int32_t y);
+    bool getNodePosition(uint8_t address, int32_t* x, int32_t* y);
+    NodePosition* getPositionTable();
+    uint8_t getPositionTableSize();
+    
+    // Event trace, kept when the policy sets traceBufferSize; dumping empties it
+    uint8_t dumpTrace(Print& out);
+    uint8_t getTraceCount();
+    void clearTrace();
+    
 private:
+    template <class> friend class LoRaMeshBridgeT;
+    
+    LoRaClass* _radio;
+    LoRaMeshBridgeT<Config>* _bridge;    // Shared forwarding core, NULL when standalone
     uint8_t _address;
-    uint8_t _messageId;
+    uint32_t _sequence;     // Extended message counter; the low 8 bits go out as the message ID
     uint8_t _retries;
     uint16_t _retryTimeout;
     
-    RoutingEntry _routingTable[LORAMESH_ROUTING_TABLE_SIZE];
+    RoutingEntry _routingTable[Config::routingTableSize];
+    
+    // Per-neighbor state for adaptive data rate, low-power listen and flow control
+    LoRaMeshTable<NeighborLink, (Config::adaptiveDataRate || Config::lowPowerListen || Config::flowControl) ?
+                  Config::neighborTableSize : 0> _neighborTable;
+    uint8_t _adrEnabled : 1;
+    uint8_t _radioStarted : 1;
+    uint8_t _lplSleep : 1;
+    uint8_t _radioAsleep : 1;
+    uint8_t _secureMode : 1;
+    uint8_t _receiptsEnabled : 1;
+    uint8_t _sourceRouting : 1;
+    uint8_t _groupReport : 1;        // Membership changed; report on the next process()
+    
+    uint8_t _spreadingFactor;
+    uint8_t _codingRate;
+    uint8_t _activeCodingRate;   // Settings currently programmed into the radio
+    int8_t _txPower;
+    int8_t _activeTxPower;
+    long _signalBandwidth;
+    
+    // Transmit accounting
+    unsigned long _txAirtime;        // Total time on air in milliseconds
+    unsigned long _txEnergy;         // Total transmit energy in microjoules
+    unsigned long _deliveredBytes;   // Payload bytes confirmed by a first-hop ACK
+    unsigned long _deliveredMessages;
+    
+    // Low-power listen state
+    uint16_t _lplInterval;           // Wake interval in ms, 0 = continuous receive
+    uint16_t _activePreambleLength;
+    unsigned long _lplLastWake;
+    unsigned long _radioTimeMark;    // millis() of the last listen/sleep accounting update
+    unsigned long _listenTime;       // ms spent awake in receive or CAD
+    unsigned long _sleepTime;        // ms spent with the radio asleep
+    
+    // Frame security state
+    struct LinkKey {
+        uint8_t neighbor;
+        uint8_t valid;
+        LoRaMeshCipher cipher;
+    };
+    LoRaMeshTable<LoRaMeshCipher, Config::security> _networkCipher;
+    LoRaMeshTable<LinkKey, Config::security ? Config::linkKeyTableSize : 0> _linkKeys;
+    uint32_t _frameCounter;
+    
+    ReplayEntry _replayTable[Config::replayTableSize];
+    
+    // Warm-restart snapshot state
+    LoRaMeshStorageRead _storageRead;
+    LoRaMeshStorageWrite _storageWrite;
+    LoRaMeshStorageCommit _storageCommit;
+    uint16_t _storageBase;
+    uint32_t _sequenceLease;         // Counters below these values may already have been used
+    uint32_t _frameCounterLease;
+    uint8_t _snapshotCursor;         // Next table record written to storage
+    unsigned long _snapshotTime;     // millis() when the current pass started
+    
+    // End-to-end receipt state
+    OutstandingSend _outstandingTable[Config::outstandingTableSize];
+    uint8_t _lastMessageId;          // Last data message originated by sendToWait
+    struct ReceiptSlot {
+        uint8_t destination;
+        uint8_t count;
+        unsigned long firstTime;                          // millis() of the first queued receipt
+        uint8_t messageIds[LORAMESH_RECEIPT_BATCH];
+        uint16_t receiveTimes[LORAMESH_RECEIPT_BATCH];    // ms after firstTime
+    };
+    LoRaMeshTable<ReceiptSlot, Config::deliveryReceipts ? Config::receiptQueueSize : 0> _receiptQueue;
+    
+    // Relay paths learned from discovery, used when source routing is on
+    struct SourceRoute {
+        uint8_t destination;
+        uint8_t length;            // Relays between us and the destination
+        uint8_t valid : 1;         // Pack into single bit
+        uint8_t reserved : 7;      // Reserved for future use
+        uint16_t lastSeenAge;      // Age in seconds instead of absolute timestamp
+        uint8_t hops[Config::maxHops];
+    };
+    LoRaMeshTable<SourceRoute, Config::sourceRouting ? Config::sourceRouteTableSize : 0> _sourceRoutes;
+    
+    // Multicast group state
+    LoRaMeshTable<GroupMember, Config::multicast ? Config::groupMemberTableSize : 0> _groupMembers;
+    uint16_t _groupMask;             // Groups this node has joined, one bit each
+    unsigned long _groupReportTime;  // millis() of our last membership report
+    
+    // Trickle dissemination state
+    struct DisseminationState {
+        uint8_t* buffer;
+        uint16_t capacity;
+        uint16_t version;          // Version held or being fetched, 0 = none
+        uint16_t length;
+        uint8_t source;            // Neighbor that advertised the version complete
+        uint8_t complete : 1;      // Every chunk of version is held
+        uint8_t updated : 1;       // Completed version not yet reported by disseminationUpdated()
+        uint8_t fired : 1;         // Summary slot of the current interval has passed
+        uint8_t reserved : 5;      // Reserved for future use
+        uint8_t counter;           // Consistent summaries heard this interval
+        uint8_t doublings;         // Current interval is LORAMESH_TRICKLE_IMIN << doublings
+        unsigned long intervalStart;
+        unsigned long fireDelay;   // ms into the interval when our summary is due
+        unsigned long requestTime; // millis() of our last chunk request
+        unsigned long sendTime;    // millis() after which the next requested chunk goes out
+        uint8_t held[(Config::maxChunks + 7) / 8];       // Chunks of version held
+        uint8_t requested[(Config::maxChunks + 7) / 8];  // Chunks neighbors asked us for
+    };
+    LoRaMeshTable<DisseminationState, Config::dissemination> _dissemination;
+    
+    // Geographic routing state
+    LoRaMeshTable<NodePosition, Config::geographicRouting ? Config::positionTableSize : 0> _positions;
+    int32_t _positionX;
+    int32_t _positionY;
+    uint8_t _positionSet : 1;        // setPosition() called; this node forwards greedily
+    uint8_t _positionReserved : 7;   // Reserved for future use
+    unsigned long _positionBeaconTime;  // millis() when our next position beacon is due
+    
+    LoRaMeshTrace<Config::traceBufferSize> _trace;
     
     // Message buffering - circular buffer for received messages
     struct MessageBuffer {
-        MeshHeader header;
+        Header header;
         uint8_t data[LORAMESH_MAX_MESSAGE_LEN];
         uint8_t dataLen;
         uint8_t valid : 1;       // Pack into single bit
         uint8_t reserved : 7;    // Reserved for future use
         uint16_t timestampAge;   // Age in seconds instead of absolute timestamp (saves 2 bytes per message)
     };
-    MessageBuffer _rxBuffer[LORAMESH_MESSAGE_BUFFER_SIZE];
+    MessageBuffer _rxBuffer[Config::messageBufferSize];
     uint8_t _rxBufferHead;
     uint8_t _rxBufferTail;
     
@@ -143,21 +780,23 @@ private:
         uint8_t destination;
         uint8_t messageId;
         uint8_t ackReceived : 1;   // Pack into single bit
-        uint8_t reserved : 7;      // Reserved for future use
+        uint8_t congestion : 2;    // LORAMESH_CONGESTION_* state reported in the ACK
+        uint8_t reserved : 5;      // Reserved for future use
         uint16_t timestampAge;     // Age in milliseconds/10 instead of absolute timestamp
     } _ackTracker;
     
-    // Pending messages waiting for route discovery
+    // Originated messages waiting for route discovery and, with flow control,
+    // frames accepted for forwarding; both are sent from process()
     struct PendingMessage {
-        uint8_t destination;
+        Header header;            // Relayed frames keep their path and flags
         uint8_t data[LORAMESH_MAX_MESSAGE_LEN];
         uint8_t dataLen;
-        uint8_t messageId;
         uint8_t valid : 1;        // Pack into single bit
-        uint8_t reserved : 7;     // Reserved for future use
-        uint16_t timestampAge;    // Age in seconds instead of absolute timestamp
+        uint8_t relayed : 1;      // Forwarded for another node; no route discovery
+        uint8_t reserved : 6;     // Reserved for future use
+        unsigned long queuedTime; // millis() when the message was queued
     };
-    PendingMessage _pendingQueue[LORAMESH_PENDING_QUEUE_SIZE];
+    PendingMessage _pendingQueue[Config::pendingQueueSize];
     
     struct {
         uint8_t destination;
@@ -167,22 +806,117 @@ private:
         uint8_t reserved : 7;      // Reserved for future use
     } _routeDiscovery;
     
-    bool sendPacket(MeshHeader& header, const uint8_t* data, uint8_t len);
-    bool sendPacketWithAck(MeshHeader& header, const uint8_t* data, uint8_t len);
+    // Runtime switches, folded away when the policy disables the feature
+    bool adrActive() { return Config::adaptiveDataRate && _adrEnabled; }
+    bool lplActive() { return Config::lowPowerListen && _lplInterval > 0; }
+    bool secureActive() { return Config::security && _secureMode; }
+    bool receiptsActive() { return Config::deliveryReceipts && _receiptsEnabled; }
+    bool sourceRoutingActive() { return Config::sourceRouting && _sourceRouting; }
+    bool persistActive() { return Config::persistentState && _storageWrite != NULL; }
+    bool multicastActive() { return Config::multicast; }
+    bool disseminationActive() { return Config::dissemination && _dissemination->buffer != NULL; }
+    bool flowControlActive() { return Config::flowControl; }
+    bool geoActive() { return Config::geographicRouting && _positionSet; }
+    bool isGroupAddress(uint8_t address) { return address >= LORAMESH_GROUP_BASE && address < LORAMESH_BROADCAST_ADDRESS; }
+    
+    bool sendPacket(Header& header, const uint8_t* data, uint8_t len);
+    bool sendPacketWithAck(Header& header, const uint8_t* data, uint8_t len);
     bool receivePacket();
-    void sendAck(uint8_t destination, uint8_t messageId);
+    void sendAck(uint8_t destination, uint8_t messageId, bool direct = false,
+                 uint8_t congestion = LORAMESH_CONGESTION_NONE);
+    void sendHopAck(Header& header, uint8_t congestion = LORAMESH_CONGESTION_NONE);
+    bool getNextHop(Header& header, uint8_t& nextHop);
+    
+    NeighborLink* findNeighbor(uint8_t address);
+    NeighborLink* getOrCreateNeighbor(uint8_t address);
+    void applyLinkSettings(uint8_t nextHop);
+    void updateLinkAdr(uint8_t address, bool acked);
+    void handleAdrReport(uint8_t address, int8_t snr, uint8_t preferredCodingRate);
+    uint8_t getPreferredCodingRate(int8_t snr);
+    int8_t getRequiredSnr();
+    unsigned long getAirtime(uint8_t frameLen, uint8_t codingRate);
     
-    void handleDataMessage(MeshHeader& header, uint8_t* data, uint8_t len);
-    void handleRouteRequest(MeshHeader& header);
-    void handleRouteReply(MeshHeader& header);
-    void handleRouteFailure(MeshHeader& header, uint8_t* data, uint8_t len);
-    void handleAck(MeshHeader& header);
+    void processLowPowerListen();
+    bool sampleChannel();
+    void sleepRadio();
+    void accountRadioTime();
+    void applyWakeTiming(uint8_t nextHop, uint8_t messageType);
+    uint16_t getNextWakeDelay();
+    void handleWakeReport(uint8_t address, uint16_t wakeDelay);
     
-    void extractRoutesFromPath(MeshHeader& header, bool isRequest);
-    void addToMessageBuffer(MeshHeader& header, uint8_t* data, uint8_t len);
+    LoRaMeshCipher* getCipher(uint8_t neighbor);
+    void buildNonce(uint8_t* nonce, const uint8_t* frame, uint8_t transmitter, uint32_t counter);
+    void sealFrame(uint8_t* frame, uint8_t headerLen, uint8_t len, uint8_t nextHop);
+    bool openFrame(uint8_t* frame, uint8_t frameLen);
+    
+    ReplayEntry* getReplayEntry(uint8_t address);
+    bool checkReplayWindow(uint32_t& highest, uint32_t& bitmap, int32_t delta);
+    bool isDuplicateMessage(uint8_t source, uint8_t messageId);
+    bool isReplayedFrame(uint8_t transmitter, uint32_t counter);
+    
+    void handleDataMessage(Header& header, uint8_t* data, uint8_t len);
+    void handleRouteRequest(Header& header);
+    void handleRouteReply(Header& header);
+    void handleRouteFailure(Header& header, uint8_t* data, uint8_t len);
+    void handleAck(Header& header, uint8_t* data, uint8_t len);
+    void handleReceipt(Header& header, uint8_t* data, uint8_t len);
+    
+    void extractRoutesFromPath(Header& header, bool isRequest);
+    void addToMessageBuffer(Header& header, uint8_t* data, uint8_t len);
     bool getFromMessageBuffer(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id);
-    void addToPendingQueue(uint8_t destination, const uint8_t* data, uint8_t len, uint8_t messageId);
+    bool addToPendingQueue(uint8_t destination, const uint8_t* data, uint8_t len, uint8_t messageId);
     void processPendingMessages();
+    void removeFromPendingQueue(uint8_t destination, uint8_t messageId);
+    bool queueForward(Header& header, const uint8_t* data, uint8_t len);
+    uint8_t getCongestion(bool relay);
+    void handleCongestionReport(uint8_t address, uint8_t congestion);
+    void waitForPacing(uint8_t nextHop);
+    bool isPaced(uint8_t nextHop);
+    
+    OutstandingSend* addOutstandingSend(uint8_t destination, uint8_t messageId);
+    OutstandingSend* findOutstandingSend(uint8_t messageId);
+    void queueReceipt(uint8_t destination, uint8_t messageId);
+    void processReceipts();
+    void flushReceipts(uint8_t slot);
+    
+    SourceRoute* findSourceRoute(uint8_t destination);
+    void learnSourceRoute(uint8_t destination, const uint8_t* hops, uint8_t length, bool reversed);
+    void clearSourceRoute(uint8_t destination);
+    bool applySourceRoute(Header& header, uint8_t len);
+    
+    bool sendToGroup(uint8_t group, const uint8_t* data, uint8_t len);
+    bool forwardToGroup(Header& header, const uint8_t* members, uint8_t count, const uint8_t* data, uint8_t len);
+    uint8_t getGroupNextHop(uint8_t member);
+    GroupMember* findGroupMember(uint8_t address);
+    void handleGroupReport(Header& header, uint8_t* data, uint8_t len);
+    void handleMulticastMessage(Header& header, uint8_t* data, uint8_t len);
+    void sendGroupReport();
+    void processGroups();
+    
+    uint8_t getChunkCount();
+    void handleSummary(Header& header, uint8_t* data, uint8_t len);
+    void handleChunkRequest(Header& header, uint8_t* data, uint8_t len);
+    void handleChunk(Header& header, uint8_t* data, uint8_t len);
+    bool adoptVersion(uint16_t version, uint16_t length);
+    void sendSummary();
+    void sendChunkRequest();
+    void sendChunk(uint8_t index);
+    void resetTrickle();
+    void startTrickleInterval();
+    void processDissemination();
+    
+    NodePosition* findPosition(uint8_t address);
+    NodePosition* learnPosition(uint8_t address, int32_t x, int32_t y, bool neighbor);
+    uint8_t getGeoNextHop(Header& header, int32_t x, int32_t y);
+    bool applyGeoRoute(Header& header, uint8_t len);
+    bool sendGeo(Header& header, const uint8_t* data, uint8_t len);
+    void handlePosition(Header& header, uint8_t* data, uint8_t len);
+    void handleGeoMessage(Header& header, uint8_t* data, uint8_t len);
+    void sendPositionBeacon();
+    void processPositions();
+    float getDistance(int32_t x, int32_t y, int32_t targetX, int32_t targetY);
+    static void putCoordinate(uint8_t* buffer, int32_t value);
+    static int32_t getCoordinate(const uint8_t* buffer);
     
     bool startRouteDiscovery(uint8_t destination);
     void updateRoutingTable(uint8_t destination, uint8_t nextHop, uint8_t hopCount);
@@ -190,15 +924,31 @@ private:
     void clearRoute(uint8_t destination);
     void cleanupRoutingTable();
     
-    bool isNodeVisited(MeshHeader& header, uint8_t node);
-    void addVisitedNode(MeshHeader& header, uint8_t node);
+    bool isNodeVisited(Header& header, uint8_t node);
+    void addVisitedNode(Header& header, uint8_t node);
     
     uint8_t getNextMessageId();
     
+    void traceFrame(uint8_t event, const uint8_t* frame, uint8_t frameLen, uint8_t arg = 0);
+    void traceEvent(uint8_t event, Header& header, uint8_t nextHop, uint8_t arg = 0);
+    
+    void restoreSnapshot();
+    void persistSnapshot();
+    void persistCounters();
+    bool storeByte(uint16_t offset, uint8_t value);
+    uint32_t loadCounter(uint16_t offset);
+    bool storeCounter(uint16_t offset, uint32_t value);
+    
     // Helper functions for age-based timestamp system
     uint16_t getAgeFromTime(unsigned long timestamp);
     unsigned long getTimeFromAge(uint16_t age);
     bool isAgeExpired(uint16_t age, uint16_t timeoutSeconds);
 };
 
+// The default instantiation, sized by the LORAMESH_* macros above
+typedef LoRaMeshT<> LoRaMesh;
+
+#include "LoRaMeshBridge.h"
+#include "LoRaMeshImpl.h"
+
 #endif
\ No newline at end of file
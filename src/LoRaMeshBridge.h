@@ -0,0 +1,240 @@
+#ifndef LORAMESH_BRIDGE_H
+#define LORAMESH_BRIDGE_H
+
+// Shared forwarding core for gateways with one LoRaMeshT instance per transceiver.
+// Every instance keeps the routing table for its own channel; the bridge hands
+// traffic between them and answers route requests on one channel for
+// destinations it knows on another. Included by LoRaMesh.h.
+template <class Config = LoRaMeshDefaultConfig>
+class LoRaMeshBridgeT {
+public:
+    typedef typename LoRaMeshT<Config>::Header Header;
+    
+    LoRaMeshBridgeT();
+    
+    // Join a mesh instance; roles is a mask of LORAMESH_RADIO_* flags
+    bool addRadio(LoRaMeshT<Config>& mesh, uint8_t roles = LORAMESH_RADIO_DATA | LORAMESH_RADIO_DISCOVERY);
+    uint8_t getRadioCount();
+    
+    // Send through whichever data radio has a route, discovering on every discovery radio
+    bool sendToWait(uint8_t destination, const uint8_t* data, uint8_t len);
+    bool recvFromAck(uint8_t* buf, uint8_t* len, uint8_t* source = NULL, uint8_t* dest = NULL, uint8_t* id = NULL, uint8_t* radio = NULL);
+    
+    bool available();
+    void process();
+    
+    // Index of the data radio holding a valid route, -1 if none
+    int8_t findRadio(uint8_t destination);
+
+private:
+    template <class> friend class LoRaMeshT;
+    
+    struct {
+        LoRaMeshT<Config>* mesh;
+        uint8_t roles;
+        uint8_t busy : 1;        // Inside a blocking exchange; not polled or forwarded to
+        uint8_t reserved : 7;    // Reserved for future use
+    } _radios[LORAMESH_MAX_RADIOS];
+    uint8_t _radioCount;
+    uint8_t _nextRadio;          // Round-robin start so one busy channel cannot starve the rest
+    
+    int8_t indexOf(LoRaMeshT<Config>* mesh);
+    bool forward(LoRaMeshT<Config>* from, Header& header, const uint8_t* data, uint8_t len);
+    bool proxyRoute(LoRaMeshT<Config>* from, uint8_t destination);
+    void poll(LoRaMeshT<Config>* from);
+};
+
+typedef LoRaMeshBridgeT<> LoRaMeshBridge;
+
+template <class Config>
+LoRaMeshBridgeT<Config>::LoRaMeshBridgeT() {
+    _radioCount = 0;
+    _nextRadio = 0;
+}
+
+template <class Config>
+bool LoRaMeshBridgeT<Config>::addRadio(LoRaMeshT<Config>& mesh, uint8_t roles) {
+    if (_radioCount >= LORAMESH_MAX_RADIOS || mesh._bridge) {
+        return false;
+    }
+    
+    _radios[_radioCount].mesh = &mesh;
+    _radios[_radioCount].roles = roles;
+    _radios[_radioCount].busy = 0;
+    _radioCount++;
+    mesh._bridge = this;
+    return true;
+}
+
+template <class Config>
+uint8_t LoRaMeshBridgeT<Config>::getRadioCount() {
+    return _radioCount;
+}
+
+template <class Config>
+bool LoRaMeshBridgeT<Config>::sendToWait(uint8_t destination, const uint8_t* data, uint8_t len) {
+    if (destination == LORAMESH_BROADCAST_ADDRESS) {
+        bool sent = false;
+        for (uint8_t i = 0; i < _radioCount; i++) {
+            if (_radios[i].roles & LORAMESH_RADIO_DATA) {
+                sent |= _radios[i].mesh->sendToWait(destination, data, len);
+            }
+        }
+        return sent;
+    }
+    
+    int8_t radio = findRadio(destination);
+    if (radio < 0) {
+        // Search every discovery channel at once and use whichever answers first
+        for (uint8_t i = 0; i < _radioCount; i++) {
+            if (_radios[i].roles & LORAMESH_RADIO_DISCOVERY) {
+                _radios[i].mesh->startRouteDiscovery(destination);
+            }
+        }
+        
+        unsigned long discoveryStart = millis();
+        while (radio < 0 && millis() - discoveryStart < LORAMESH_ROUTE_DISCOVERY_TIMEOUT) {
+            process();
+            radio = findRadio(destination);
+            delay(10);
+        }
+        
+        if (radio < 0) {
+            return false;
+        }
+    }
+    
+    return _radios[radio].mesh->sendToWait(destination, data, len);
+}
+
+template <class Config>
+bool LoRaMeshBridgeT<Config>::recvFromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* radio) {
+    for (uint8_t n = 0; n < _radioCount; n++) {
+        uint8_t i = (_nextRadio + n) % _radioCount;
+        if (_radios[i].mesh->recvFromAck(buf, len, source, dest, id)) {
+            _nextRadio = (i + 1) % _radioCount;
+            if (radio) *radio = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Config>
+bool LoRaMeshBridgeT<Config>::available() {
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (_radios[i].mesh->available()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Config>
+void LoRaMeshBridgeT<Config>::process() {
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        _radios[i].mesh->process();
+    }
+}
+
+template <class Config>
+int8_t LoRaMeshBridgeT<Config>::findRadio(uint8_t destination) {
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (!(_radios[i].roles & LORAMESH_RADIO_DATA)) {
+            continue;
+        }
+        RoutingEntry* route = _radios[i].mesh->findRoute(destination);
+        if (route && route->state == ROUTE_STATE_VALID) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <class Config>
+int8_t LoRaMeshBridgeT<Config>::indexOf(LoRaMeshT<Config>* mesh) {
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (_radios[i].mesh == mesh) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+template <class Config>
+bool LoRaMeshBridgeT<Config>::forward(LoRaMeshT<Config>* from, Header& header, const uint8_t* data, uint8_t len) {
+    int8_t source = indexOf(from);
+    if (source < 0) {
+        return false;
+    }
+    
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (i == source || _radios[i].busy || !(_radios[i].roles & LORAMESH_RADIO_DATA)) {
+            continue;
+        }
+        RoutingEntry* route = _radios[i].mesh->findRoute(header.destination);
+        if (!route || route->state != ROUTE_STATE_VALID) {
+            continue;
+        }
+        
+        // A source route ends at this gateway; the other radio routes by its table
+        header.flags &= ~MESSAGE_FLAG_SOURCE_ROUTE;
+        header.visitedCount = 0;
+        
+        // The ingress radio stays busy so nothing is bridged back to it meanwhile
+        uint8_t wasBusy = _radios[source].busy;
+        _radios[source].busy = 1;
+        bool sent = _radios[i].mesh->sendPacketWithAck(header, data, len);
+        _radios[source].busy = wasBusy;
+        return sent;
+    }
+    return false;
+}
+
+template <class Config>
+bool LoRaMeshBridgeT<Config>::proxyRoute(LoRaMeshT<Config>* from, uint8_t destination) {
+    int8_t source = indexOf(from);
+    if (source < 0 || !(_radios[source].roles & LORAMESH_RADIO_DISCOVERY)) {
+        return false;
+    }
+    
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (i != source && (_radios[i].roles & LORAMESH_RADIO_DATA)) {
+            RoutingEntry* route = _radios[i].mesh->findRoute(destination);
+            if (route && route->state == ROUTE_STATE_VALID) {
+                return true;
+            }
+        }
+    }
+    
+    // Unknown everywhere: look on the other channels so the requester's retry finds it
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (i != source && !_radios[i].busy && (_radios[i].roles & LORAMESH_RADIO_DISCOVERY)) {
+            _radios[i].mesh->startRouteDiscovery(destination);
+        }
+    }
+    return false;
+}
+
+template <class Config>
+void LoRaMeshBridgeT<Config>::poll(LoRaMeshT<Config>* from) {
+    int8_t source = indexOf(from);
+    if (source < 0) {
+        return;
+    }
+    
+    // Drain the other receivers while one radio waits for an ACK, so each
+    // added transceiver adds receive capacity instead of idling
+    uint8_t wasBusy = _radios[source].busy;
+    _radios[source].busy = 1;
+    for (uint8_t i = 0; i < _radioCount; i++) {
+        if (!_radios[i].busy) {
+            _radios[i].busy = 1;
+            _radios[i].mesh->receivePacket();
+            _radios[i].busy = 0;
+        }
+    }
+    _radios[source].busy = wasBusy;
+}
+
+#endif
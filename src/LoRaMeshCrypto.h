@@ -0,0 +1,34 @@
+#ifndef LORAMESH_CRYPTO_H
+#define LORAMESH_CRYPTO_H
+
+#include <Arduino.h>
+
+#define LORAMESH_KEY_LEN 16
+#define LORAMESH_NONCE_LEN 13
+#define LORAMESH_TAG_LEN 8
+
+// AES-128 in CCM mode (RFC 3610, 8 byte tag, 2 byte length field).
+// The round keys are expanded once in setKey() so sealing and opening a
+// frame only costs the block encryptions themselves.
+class LoRaMeshCipher {
+public:
+    void setKey(const uint8_t* key);
+    
+    // Encrypt data in place and write the authentication tag
+    void seal(const uint8_t* nonce, const uint8_t* aad, uint8_t aadLen,
+              uint8_t* data, uint8_t len, uint8_t* tag);
+    
+    // Decrypt data in place; returns false (and leaves garbage) if the tag does not match
+    bool open(const uint8_t* nonce, const uint8_t* aad, uint8_t aadLen,
+              uint8_t* data, uint8_t len, const uint8_t* tag);
+    
+private:
+    uint8_t _roundKeys[176];
+    
+    void encryptBlock(uint8_t* block);
+    void computeMac(const uint8_t* nonce, const uint8_t* aad, uint8_t aadLen,
+                    const uint8_t* data, uint8_t len, uint8_t* mac);
+    void applyKeystream(const uint8_t* nonce, uint8_t* data, uint8_t len, uint8_t* mac);
+};
+
+#endif
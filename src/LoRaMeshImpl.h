@@ -0,0 +1,3618 @@
+#ifndef LORAMESH_IMPL_H
+#define LORAMESH_IMPL_H
+
+// Member definitions of LoRaMeshT; included at the end of LoRaMesh.h
+
+template <class Config>
+LoRaMeshT<Config>::LoRaMeshT(LoRaClass& radio) {
+    _radio = &radio;
+    _bridge = NULL;
+    _address = 0x00;
+    _sequence = 0;
+    _retries = 3;
+    _retryTimeout = 200;
+    _routeDiscovery.active = 0;
+    
+    // Initialize message buffer
+    _rxBufferHead = 0;
+    _rxBufferTail = 0;
+    for (int i = 0; i < Config::messageBufferSize; i++) {
+        _rxBuffer[i].valid = 0;
+    }
+    
+    // Initialize pending queue
+    for (int i = 0; i < Config::pendingQueueSize; i++) {
+        _pendingQueue[i].valid = 0;
+    }
+    
+    // Initialize ACK tracker
+    _ackTracker.ackReceived = 0;
+    _ackTracker.congestion = LORAMESH_CONGESTION_NONE;
+    
+    for (int i = 0; i < Config::routingTableSize; i++) {
+        _routingTable[i].state = ROUTE_STATE_INVALID;
+    }
+    
+    // Initialize adaptive data rate state (arduino-LoRa defaults)
+    for (int i = 0; i < _neighborTable.size; i++) {
+        _neighborTable[i].valid = 0;
+    }
+    _adrEnabled = 0;
+    _radioStarted = 0;
+    _spreadingFactor = 7;
+    _signalBandwidth = 125E3;
+    _codingRate = 5;
+    _txPower = 17;
+    _activeCodingRate = _codingRate;
+    _activeTxPower = _txPower;
+    
+    _txAirtime = 0;
+    _txEnergy = 0;
+    _deliveredBytes = 0;
+    _deliveredMessages = 0;
+    
+    // Continuous receive until setLowPowerListen() is called
+    _lplInterval = 0;
+    _lplSleep = 0;
+    _radioAsleep = 0;
+    _activePreambleLength = 8;
+    _lplLastWake = 0;
+    _radioTimeMark = 0;
+    _listenTime = 0;
+    _sleepTime = 0;
+    
+    // Frames go out in the clear until a network key is set
+    _secureMode = 0;
+    _frameCounter = 0;
+    for (int i = 0; i < _linkKeys.size; i++) {
+        _linkKeys[i].valid = 0;
+    }
+    
+    for (int i = 0; i < Config::replayTableSize; i++) {
+        _replayTable[i].valid = 0;
+    }
+    
+    // End-to-end receipts are off until setDeliveryReceipts(true)
+    _receiptsEnabled = 0;
+    _lastMessageId = 0;
+    for (int i = 0; i < Config::outstandingTableSize; i++) {
+        _outstandingTable[i].state = DELIVERY_NONE;
+    }
+    for (int i = 0; i < _receiptQueue.size; i++) {
+        _receiptQueue[i].count = 0;
+    }
+    
+    // Data frames are table-routed hop by hop until setSourceRouting(true)
+    _sourceRouting = 0;
+    for (int i = 0; i < _sourceRoutes.size; i++) {
+        _sourceRoutes[i].valid = 0;
+    }
+    
+    // Nothing survives a reset until setPersistence() provides storage
+    _storageRead = NULL;
+    _storageWrite = NULL;
+    _storageCommit = NULL;
+    _storageBase = 0;
+    _sequenceLease = 0;
+    _frameCounterLease = 0;
+    _snapshotCursor = 0;
+    _snapshotTime = 0;
+    
+    // No groups joined; members are learned from their reports
+    _groupMask = 0;
+    _groupReport = 0;
+    _groupReportTime = 0;
+    for (int i = 0; i < _groupMembers.size; i++) {
+        _groupMembers[i].valid = 0;
+    }
+    
+    // Geographic forwarding stays off until setPosition()
+    for (int i = 0; i < _positions.size; i++) {
+        _positions[i].valid = 0;
+    }
+    _positionSet = 0;
+    _positionBeaconTime = 0;
+    
+    // Dissemination stays off until setDisseminationBuffer()
+    if (Config::dissemination) {
+        _dissemination->buffer = NULL;
+        _dissemination->capacity = 0;
+        _dissemination->version = 0;
+        _dissemination->length = 0;
+        _dissemination->complete = 0;
+        _dissemination->updated = 0;
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::begin(long frequency, uint8_t address) {
+    _address = address;
+    if (!_radio->begin(frequency)) {
+        return false;
+    }
+    
+    _radioStarted = 1;
+    _radio->setSpreadingFactor(_spreadingFactor);
+    _radio->setSignalBandwidth(_signalBandwidth);
+    _radio->setCodingRate4(_codingRate);
+    _radio->setTxPower(_txPower);
+    _activeCodingRate = _codingRate;
+    _activeTxPower = _txPower;
+    _radioTimeMark = millis();
+    
+    // Random first message ID, so receivers that still remember the IDs from
+    // before a reset do not take new messages for retransmissions
+    _sequence = _radio->random();
+    
+    if (persistActive()) {
+        restoreSnapshot();
+    }
+    return true;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setAddress(uint8_t address) {
+    _address = address;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getAddress() {
+    return _address;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setSPI(SPIClass& spi) {
+    _radio->setSPI(spi);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setPins(int ss, int reset, int dio0) {
+    _radio->setPins(ss, reset, dio0);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setSPIFrequency(uint32_t frequency) {
+    _radio->setSPIFrequency(frequency);
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::sendToWait(uint8_t destination, const uint8_t* data, uint8_t len, uint8_t* flags) {
+    // Refused here rather than failing to build later and passing for a dead link
+    if (len > getMaxMessageLen() ||
+        (destination == LORAMESH_BROADCAST_ADDRESS && len > getMaxMessageLen() - Config::maxHops)) {
+        return false;
+    }
+    
+    if (destination == _address) {
+        return false;
+    }
+    
+    cleanupRoutingTable();
+    
+    if (isGroupAddress(destination)) {
+        return multicastActive() && sendToGroup(destination, data, len);
+    }
+    
+    Header header;
+    header.destination = destination;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_DATA;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    // Route requests and control frames sent meanwhile take IDs from the same sequence
+    _lastMessageId = header.messageId;
+    
+    OutstandingSend* send = NULL;
+    if (destination != LORAMESH_BROADCAST_ADDRESS) {
+        send = addOutstandingSend(destination, header.messageId);
+        if (receiptsActive()) {
+            header.flags |= MESSAGE_FLAG_RECEIPT;
+        }
+    }
+    
+    RoutingEntry* route = findRoute(destination);
+    bool sourceRouted = destination != LORAMESH_BROADCAST_ADDRESS && applySourceRoute(header, len);
+    
+    // Without a route, head for the destination's position rather than flood
+    bool geoRouted = destination != LORAMESH_BROADCAST_ADDRESS && !sourceRouted &&
+                     (!route || route->state != ROUTE_STATE_VALID) && applyGeoRoute(header, len);
+    
+    if (destination != LORAMESH_BROADCAST_ADDRESS && !sourceRouted && !geoRouted &&
+        (!route || route->state != ROUTE_STATE_VALID)) {
+        // No route - add to pending queue and start discovery
+        if (!addToPendingQueue(destination, data, len, header.messageId)) {
+            send->state = DELIVERY_FAILED;
+            return false;
+        }
+        
+        if (!startRouteDiscovery(destination)) {
+            removeFromPendingQueue(destination, header.messageId);
+            send->state = DELIVERY_FAILED;
+            return false;
+        }
+        
+        // Wait for route discovery; processPendingMessages sends the message
+        // as soon as the route appears and records the first-hop result
+        unsigned long discoveryStart = millis();
+        while (send->state == DELIVERY_PENDING &&
+               millis() - discoveryStart < LORAMESH_ROUTE_DISCOVERY_TIMEOUT) {
+            process();
+            if (send->state != DELIVERY_PENDING) {
+                break;
+            }
+            
+            // Check if route discovery has been cleared (failed)
+            route = findRoute(destination);
+            if (!_routeDiscovery.active && (!route || route->state != ROUTE_STATE_VALID)) {
+                // Route discovery failed
+                break;
+            }
+            
+            delay(10);
+        }
+        
+        if (send->state == DELIVERY_PENDING) {
+            traceEvent(TRACE_DISCOVERY_FAIL, header, LORAMESH_BROADCAST_ADDRESS);
+            
+            // Timeout - clear the active discovery
+            if (_routeDiscovery.active && _routeDiscovery.destination == destination) {
+                _routeDiscovery.active = 0;
+            }
+            removeFromPendingQueue(destination, header.messageId);
+            send->state = DELIVERY_FAILED;
+        }
+    } else {
+        // We have a route - send immediately
+        bool sent = geoRouted ? sendGeo(header, data, len) : sendPacketWithAck(header, data, len);
+        if (!send) {
+            return sent;
+        }
+        send->state = sent ? DELIVERY_FORWARDED : DELIVERY_FAILED;
+    }
+    
+    if (!receiptsActive() || send->state != DELIVERY_FORWARDED) {
+        return send->state == DELIVERY_FORWARDED;
+    }
+    
+    // Wait for the end-to-end receipt from the destination
+    unsigned long receiptStart = millis();
+    while (send->state == DELIVERY_FORWARDED &&
+           millis() - receiptStart < LORAMESH_RECEIPT_TIMEOUT) {
+        process();
+        delay(10);
+    }
+    return send->state == DELIVERY_CONFIRMED;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getMaxMessageLen() {
+    // Header without a path, security trailer
+    return LORAMESH_MAX_FRAME_LEN - 8 - (secureActive() ? LORAMESH_SECURE_OVERHEAD : 0);
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::recvFromAck(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id, uint8_t* flags) {
+    process();
+    
+    return getFromMessageBuffer(buf, len, source, dest, id);
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::available() {
+    process();
+    // Check if there are any valid data messages in the buffer
+    uint8_t temp = _rxBufferTail;
+    while (temp != _rxBufferHead) {
+        if (_rxBuffer[temp].valid && _rxBuffer[temp].header.messageType == MESSAGE_TYPE_DATA) {
+            return true;
+        }
+        temp = (temp + 1) % Config::messageBufferSize;
+    }
+    return false;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::process() {
+    if (lplActive() && _lplSleep) {
+        processLowPowerListen();
+    } else {
+        receivePacket();
+    }
+    processPendingMessages();
+    processReceipts();
+    
+    if (multicastActive()) {
+        processGroups();
+    }
+    if (disseminationActive()) {
+        processDissemination();
+    }
+    if (geoActive()) {
+        processPositions();
+    }
+    
+    if (persistActive()) {
+        persistSnapshot();
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::sendPacket(Header& header, const uint8_t* data, uint8_t len) {
+    uint8_t nextHop = LORAMESH_BROADCAST_ADDRESS;
+    
+    if (header.destination == LORAMESH_BROADCAST_ADDRESS || 
+        header.messageType == MESSAGE_TYPE_ROUTE_REQUEST) {
+        header.hopCount++;
+        addVisitedNode(header, _address);
+    } else if (!getNextHop(header, nextHop)) {
+        return false;
+    }
+    
+    uint8_t headerLen = 8 + header.visitedCount;
+    uint8_t overhead = secureActive() ? LORAMESH_SECURE_OVERHEAD : 0;
+    if (headerLen + len + overhead > LORAMESH_MAX_FRAME_LEN) {
+        return false;
+    }
+    
+    // Storage detached after the key was set: counters can no longer be leased
+    if (secureActive() && !persistActive()) {
+        return false;
+    }
+    
+    applyLinkSettings(nextHop);
+    applyWakeTiming(nextHop, header.messageType);
+    
+    // Transmitting wakes the radio; sleep time stops accruing here
+    if (_radioAsleep) {
+        accountRadioTime();
+        _radioAsleep = 0;
+    }
+    
+    uint8_t frame[LORAMESH_MAX_FRAME_LEN];
+    frame[0] = header.destination;
+    frame[1] = header.source;
+    frame[2] = header.messageId;
+    frame[3] = header.messageType | header.flags;
+    frame[4] = header.hopCount;
+    frame[5] = header.visitedCount;
+    memcpy(&frame[6], header.visitedNodes, header.visitedCount);
+    frame[6 + header.visitedCount] = nextHop;
+    frame[7 + header.visitedCount] = len;
+    memcpy(&frame[headerLen], data, len);
+    
+    if (secureActive()) {
+        sealFrame(frame, headerLen, len, nextHop);
+    }
+    uint8_t frameLen = headerLen + len + overhead;
+    
+    _radio->beginPacket();
+    _radio->write(frame, frameLen);
+    if (!_radio->endPacket()) {
+        return false;
+    }
+    traceFrame(TRACE_TX, frame, frameLen);
+    
+    // Account airtime and energy for the frame just sent
+    unsigned long airtime = getAirtime(frameLen, _activeCodingRate);
+    float outputMw = pow(10.0, _activeTxPower / 10.0);
+    // Supply current: ~28 mA radio baseline plus PA draw at ~25% efficiency
+    unsigned long currentMa = 28 + (unsigned long)(outputMw * 4000.0 / LORAMESH_SUPPLY_VOLTAGE_MV);
+    _txAirtime += airtime / 1000;
+    _txEnergy += (unsigned long)((float)LORAMESH_SUPPLY_VOLTAGE_MV * currentMa * airtime / 1000000.0);
+    return true;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::sendPacketWithAck(Header& header, const uint8_t* data, uint8_t len) {
+    // Messages that don't need ACK
+    if (header.destination == LORAMESH_BROADCAST_ADDRESS || 
+        header.messageType == MESSAGE_TYPE_ROUTE_REQUEST ||
+        header.messageType == MESSAGE_TYPE_ACK) {
+        return sendPacket(header, data, len);
+    }
+    
+    // Find the next hop
+    uint8_t nextHop;
+    if (!getNextHop(header, nextHop)) {
+        // The destination may sit behind another radio of this gateway
+        if (_bridge && header.messageType != MESSAGE_TYPE_ROUTE_REPLY) {
+            return _bridge->forward(this, header, data, len);
+        }
+        return false;
+    }
+    
+    // Try sending with ACK
+    bool refused = false;
+    bool transmitted = false;
+    for (uint8_t retry = 0; retry <= LORAMESH_MAX_ACK_RETRIES; retry++) {
+        if (retry > 0) {
+            traceEvent(TRACE_RETRY, header, nextHop, retry);
+        }
+        
+        // Data to a congested neighbor waits out its pacing gap
+        if (flowControlActive() && (header.messageType == MESSAGE_TYPE_DATA ||
+                                    header.messageType == MESSAGE_TYPE_GEO_DATA)) {
+            waitForPacing(nextHop);
+        }
+        
+        // Setup ACK tracker
+        _ackTracker.destination = nextHop;
+        _ackTracker.messageId = header.messageId;
+        _ackTracker.ackReceived = 0;
+        _ackTracker.congestion = LORAMESH_CONGESTION_NONE;
+        _ackTracker.timestampAge = 0;
+        
+        // Send the packet
+        if (!sendPacket(header, data, len)) {
+            continue;
+        }
+        transmitted = true;
+        
+        // Wait for ACK; the other radios of a gateway keep receiving meanwhile
+        unsigned long ackStart = millis();
+        refused = false;
+        while (millis() - ackStart < LORAMESH_ACK_TIMEOUT) {
+            if (_bridge) {
+                _bridge->poll(this);
+            }
+            if (receivePacket()) {
+                if (_ackTracker.ackReceived) {
+                    if (flowControlActive() && (header.messageType == MESSAGE_TYPE_DATA ||
+                                                header.messageType == MESSAGE_TYPE_GEO_DATA)) {
+                        handleCongestionReport(nextHop, _ackTracker.congestion);
+                        if (_ackTracker.congestion != LORAMESH_CONGESTION_NONE) {
+                            traceEvent(TRACE_CONGESTION, header, nextHop, _ackTracker.congestion);
+                        }
+                        
+                        // Heard but not taken: the link is fine, the queue behind it is not
+                        if (_ackTracker.congestion == LORAMESH_CONGESTION_FULL) {
+                            refused = true;
+                            break;
+                        }
+                    }
+                    
+                    traceEvent(TRACE_ACK, header, nextHop, retry);
+                    if (adrActive()) {
+                        updateLinkAdr(nextHop, true);
+                    }
+                    if (header.source == _address && header.messageType == MESSAGE_TYPE_GEO_DATA) {
+                        _deliveredBytes += len - LORAMESH_GEO_OVERHEAD;
+                        _deliveredMessages++;
+                    }
+                    if (header.source == _address && header.messageType == MESSAGE_TYPE_DATA) {
+                        _deliveredBytes += len;
+                        _deliveredMessages++;
+                        
+                        SourceRoute* path = findSourceRoute(header.destination);
+                        if (path && (header.flags & MESSAGE_FLAG_SOURCE_ROUTE)) {
+                            path->lastSeenAge = 0;
+                        }
+                    }
+                    return true;
+                }
+            }
+            delay(10);
+        }
+        
+        if (adrActive()) {
+            updateLinkAdr(nextHop, refused);
+        }
+        
+        // Unanswered: the learned wake time may be stale, so the retry covers
+        // the whole wake interval again
+        if (lplActive() && !refused) {
+            NeighborLink* link = findNeighbor(nextHop);
+            if (link) {
+                link->wakeTime = 0;
+            }
+        }
+    }
+    
+    // A congested next hop is no broken route, and a frame that never left
+    // says nothing about the link: keep the route and send no failure
+    if (refused || !transmitted) {
+        return false;
+    }
+    
+    traceEvent(TRACE_ACK_TIMEOUT, header, nextHop);
+    
+    // A silent neighbor is no greedy candidate until it beacons again
+    if (header.messageType == MESSAGE_TYPE_GEO_DATA) {
+        NodePosition* position = findPosition(nextHop);
+        if (position) {
+            position->neighbor = 0;
+        }
+    }
+    
+    // Failed to get ACK - notify route failure if this was a forwarded message
+    if (header.source != _address && (header.messageType == MESSAGE_TYPE_DATA ||
+                                      header.messageType == MESSAGE_TYPE_GEO_DATA)) {
+        Header failureHeader;
+        failureHeader.destination = header.source;
+        failureHeader.source = _address;
+        failureHeader.messageId = getNextMessageId();
+        failureHeader.messageType = MESSAGE_TYPE_ROUTE_FAILURE;
+        failureHeader.flags = 0;
+        failureHeader.hopCount = 0;
+        failureHeader.visitedCount = 0;
+        
+        if (header.flags & MESSAGE_FLAG_SOURCE_ROUTE) {
+            // Relays may hold no route back: reverse the part of the path already travelled
+            uint8_t position = header.hopCount - 1;
+            for (uint8_t i = 0; i < position; i++) {
+                failureHeader.visitedNodes[i] = header.visitedNodes[position - 1 - i];
+            }
+            failureHeader.visitedCount = position;
+            failureHeader.flags = MESSAGE_FLAG_SOURCE_ROUTE;
+        }
+        
+        uint8_t failureData[1] = {header.destination};
+        sendPacket(failureHeader, failureData, 1);
+    }
+    
+    if (header.source == _address) {
+        clearSourceRoute(header.destination);
+    }
+    clearRoute(header.destination);
+    return false;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::receivePacket() {
+    int packetSize = _radio->parsePacket();
+    if (packetSize == 0) return false;
+    
+    if (packetSize < 8 || packetSize > LORAMESH_MAX_FRAME_LEN) return false;
+    
+    uint8_t frame[LORAMESH_MAX_FRAME_LEN];
+    uint8_t frameLen = 0;
+    while (frameLen < packetSize && _radio->available()) {
+        frame[frameLen++] = _radio->read();
+    }
+    if (frameLen < packetSize) return false;
+    
+    traceFrame(TRACE_RX, frame, frameLen);
+    
+    // Authenticate secured frames before any header field is acted on
+    if (frame[3] & MESSAGE_FLAG_SECURE) {
+        if (!Config::security || !openFrame(frame, frameLen)) {
+            traceFrame(TRACE_DROP, frame, frameLen, TRACE_DROP_AUTH);
+            return false;
+        }
+        frameLen -= LORAMESH_SECURE_OVERHEAD;
+        frame[3] &= ~MESSAGE_FLAG_SECURE;
+    } else if (secureActive()) {
+        traceFrame(TRACE_DROP, frame, frameLen, TRACE_DROP_UNSECURED);
+        return false;
+    }
+    
+    Header header;
+    header.destination = frame[0];
+    header.source = frame[1];
+    header.messageId = frame[2];
+    header.messageType = frame[3] & ~MESSAGE_FLAG_MASK;
+    header.flags = frame[3] & MESSAGE_FLAG_MASK;
+    header.hopCount = frame[4];
+    header.visitedCount = frame[5];
+    
+    if (header.visitedCount > Config::maxHops) return false;
+    if (8 + header.visitedCount > frameLen) return false;
+    
+    memcpy(header.visitedNodes, &frame[6], header.visitedCount);
+    
+    uint8_t nextHop = frame[6 + header.visitedCount];
+    uint8_t dataLen = frame[7 + header.visitedCount];
+    
+    if (dataLen > LORAMESH_MAX_MESSAGE_LEN) return false;
+    if (8 + header.visitedCount + dataLen > frameLen) return false;
+    
+    uint8_t* data = &frame[8 + header.visitedCount];
+    
+    if (header.hopCount > Config::maxHops) return false;
+    
+    // Learn direct route to immediate neighbor (the actual sender)
+    if (header.source != _address && nextHop != LORAMESH_BROADCAST_ADDRESS && 
+        nextHop != _address) {
+        // For messages from immediate neighbors, next hop is the source
+        if (header.hopCount == 1 || header.source == nextHop) {
+            updateRoutingTable(header.source, header.source, 1);
+        }
+    }
+    
+    // Unicast frames are acted on only by the node named as next hop;
+    // everyone else just overhears them
+    if (nextHop != _address && nextHop != LORAMESH_BROADCAST_ADDRESS) {
+        return true;
+    }
+    
+    switch (header.messageType) {
+        case MESSAGE_TYPE_DATA:
+            handleDataMessage(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_ROUTE_REQUEST:
+            handleRouteRequest(header);
+            break;
+        case MESSAGE_TYPE_ROUTE_REPLY:
+            handleRouteReply(header);
+            break;
+        case MESSAGE_TYPE_ROUTE_FAILURE:
+            handleRouteFailure(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_ACK:
+            handleAck(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_RECEIPT:
+            handleReceipt(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_GROUP_REPORT:
+            handleGroupReport(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_MULTICAST:
+            handleMulticastMessage(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_SUMMARY:
+            handleSummary(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_CHUNK_REQUEST:
+            handleChunkRequest(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_CHUNK:
+            handleChunk(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_POSITION:
+            handlePosition(header, data, dataLen);
+            break;
+        case MESSAGE_TYPE_GEO_DATA:
+            handleGeoMessage(header, data, dataLen);
+            break;
+    }
+    
+    return true;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleDataMessage(Header& header, uint8_t* data, uint8_t len) {
+    bool relay = header.destination != _address && header.destination != LORAMESH_BROADCAST_ADDRESS;
+    
+    // With flow control the ACK reports how full our queue is; a full queue
+    // refuses the frame instead of dropping it, and the sender tries again later
+    uint8_t congestion = LORAMESH_CONGESTION_NONE;
+    if (flowControlActive() && header.destination != LORAMESH_BROADCAST_ADDRESS &&
+        header.source != _address) {
+        congestion = getCongestion(relay);
+    }
+    
+    // First, send ACK: unicast frames only get here on the node named as next hop
+    if (header.destination != LORAMESH_BROADCAST_ADDRESS) {
+        sendHopAck(header, congestion);
+    }
+    if (congestion == LORAMESH_CONGESTION_FULL) {
+        traceEvent(TRACE_DROP, header, LORAMESH_BROADCAST_ADDRESS, TRACE_DROP_CONGESTED);
+        return;
+    }
+    
+    // A retransmission after a lost ACK is re-acknowledged above but not delivered
+    // or forwarded a second time; our own frames relayed back are never new
+    if (header.source == _address || isDuplicateMessage(header.source, header.messageId)) {
+        return;
+    }
+    
+    if (header.destination == _address || header.destination == LORAMESH_BROADCAST_ADDRESS) {
+        // Store in message buffer
+        addToMessageBuffer(header, data, len);
+        
+        if (header.destination == _address && (header.flags & MESSAGE_FLAG_RECEIPT)) {
+            queueReceipt(header.source, header.messageId);
+        }
+        
+        // Replies and receipts can follow the same relays back
+        if (header.destination == _address && (header.flags & MESSAGE_FLAG_SOURCE_ROUTE)) {
+            learnSourceRoute(header.source, header.visitedNodes, header.visitedCount, true);
+        }
+    }
+    
+    if (relay) {
+        // Forward the message; with flow control from process(), so receiving
+        // goes on while the next hop is busy
+        header.hopCount++;
+        if (flowControlActive()) {
+            queueForward(header, data, len);
+        } else if (!sendPacketWithAck(header, data, len)) {
+            // Already handled in sendPacketWithAck
+        }
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleRouteRequest(Header& header) {
+    if (isNodeVisited(header, _address)) {
+        return;
+    }
+    
+    // Learn routes from the path in the route request
+    extractRoutesFromPath(header, true);
+    
+    if (header.destination == _address) {
+        // A full path leaves no room to append ourselves
+        if (header.visitedCount >= Config::maxHops) {
+            return;
+        }
+        
+        // The reversed request path leads back to the requester
+        if (sourceRoutingActive()) {
+            learnSourceRoute(header.source, &header.visitedNodes[1], header.visitedCount - 1, true);
+        }
+        
+        // We are the destination - send a route reply
+        Header replyHeader;
+        replyHeader.destination = header.source;
+        replyHeader.source = _address;
+        replyHeader.messageId = header.messageId;
+        replyHeader.messageType = MESSAGE_TYPE_ROUTE_REPLY;
+        replyHeader.flags = 0;
+        replyHeader.hopCount = 0;
+        replyHeader.visitedCount = header.visitedCount + 1; // Include ourselves
+        
+        // Copy visited nodes and add ourselves
+        memcpy(replyHeader.visitedNodes, header.visitedNodes, header.visitedCount);
+        replyHeader.visitedNodes[header.visitedCount] = _address;
+        
+        uint8_t emptyData[1] = {0};
+        sendPacket(replyHeader, emptyData, 0);
+    } else if (_bridge && _bridge->proxyRoute(this, header.destination)) {
+        // The destination is behind another radio of this gateway: answer for it
+        // so the requester routes through us, and keep the flood on this channel
+        if (header.visitedCount >= Config::maxHops) {
+            return;
+        }
+        
+        Header replyHeader;
+        replyHeader.destination = header.source;
+        replyHeader.source = header.destination;
+        replyHeader.messageId = header.messageId;
+        replyHeader.messageType = MESSAGE_TYPE_ROUTE_REPLY;
+        replyHeader.flags = 0;
+        replyHeader.hopCount = 0;
+        replyHeader.visitedCount = header.visitedCount + 1;
+        memcpy(replyHeader.visitedNodes, header.visitedNodes, header.visitedCount);
+        replyHeader.visitedNodes[header.visitedCount] = _address;
+        
+        uint8_t emptyData[1] = {0};
+        sendPacket(replyHeader, emptyData, 0);
+    } else {
+        // Forward the request
+        header.hopCount++;
+        addVisitedNode(header, _address);
+        
+        uint8_t emptyData[1] = {0};
+        sendPacket(header, emptyData, 0);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleRouteReply(Header& header) {
+    // Learn routes from the path in the route reply first: the hop ACK is
+    // routed back towards the replier
+    extractRoutesFromPath(header, false);
+    
+    // Relays forward replies with sendPacketWithAck
+    sendHopAck(header);
+    
+    if (header.destination == _address) {
+        // This reply is for us
+        if (_routeDiscovery.active && 
+            _routeDiscovery.messageId == header.messageId) {
+            _routeDiscovery.active = 0;
+            traceEvent(TRACE_DISCOVERY_DONE, header, _address, header.visitedCount);
+        }
+        
+        // Keep the relays between us and the replier; a gateway answering
+        // for another radio is the last relay
+        if (sourceRoutingActive() && header.visitedCount > 0) {
+            uint8_t length = header.visitedCount - 1;
+            if (length > 0 && header.visitedNodes[length] == header.source) {
+                length--;
+            }
+            learnSourceRoute(header.source, &header.visitedNodes[1], length, false);
+        }
+    } else {
+        // Forward the reply
+        RoutingEntry* route = findRoute(header.destination);
+        if (route && route->state == ROUTE_STATE_VALID) {
+            uint8_t emptyData[1] = {0};
+            sendPacketWithAck(header, emptyData, 0);
+        }
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleRouteFailure(Header& header, uint8_t* data, uint8_t len) {
+    // Send ACK for route failure message
+    sendHopAck(header);
+    
+    if (header.destination == _address && len > 0) {
+        // Clear the failed route
+        clearRoute(data[0]);
+        clearSourceRoute(data[0]);
+        
+        // Use discovery for a while; greedy forwarding may have hit a void
+        NodePosition* position = findPosition(data[0]);
+        if (position) {
+            position->failed = 1;
+            position->failureAge = 0;
+        }
+    } else if (header.destination != _address) {
+        // Forward the route failure message
+        if (header.flags & MESSAGE_FLAG_SOURCE_ROUTE) {
+            header.hopCount++;
+        }
+        sendPacketWithAck(header, data, len);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleReceipt(Header& header, uint8_t* data, uint8_t len) {
+    // Receipts travel hop by hop like route failures
+    sendHopAck(header);
+    
+    if (header.source == _address || isDuplicateMessage(header.source, header.messageId)) {
+        return;
+    }
+    
+    if (header.destination == _address) {
+        // Each entry is a message ID and how long the destination held it, in 10 ms units
+        unsigned long now = millis();
+        for (uint8_t i = 0; i + 1 < len; i += 2) {
+            OutstandingSend* send = findOutstandingSend(data[i]);
+            if (send && send->destination == header.source &&
+                send->state != DELIVERY_CONFIRMED) {
+                unsigned long elapsed = now - send->sendTime;
+                unsigned long held = (unsigned long)data[i + 1] * 10;
+                send->latency = elapsed > held ? elapsed - held : 0;
+                send->state = DELIVERY_CONFIRMED;
+            }
+        }
+    } else {
+        // Forward the receipt
+        header.hopCount++;
+        sendPacketWithAck(header, data, len);
+    }
+}
+
+template <class Config>
+typename LoRaMeshT<Config>::SourceRoute* LoRaMeshT<Config>::findSourceRoute(uint8_t destination) {
+    for (int i = 0; i < _sourceRoutes.size; i++) {
+        if (_sourceRoutes[i].valid && _sourceRoutes[i].destination == destination) {
+            return &_sourceRoutes[i];
+        }
+    }
+    return NULL;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::learnSourceRoute(uint8_t destination, const uint8_t* hops, uint8_t length, bool reversed) {
+    if (!sourceRoutingActive() || destination == _address || length > Config::maxHops) {
+        return;
+    }
+    
+    // Reuse the destination's slot, else a free one, else the oldest path
+    SourceRoute* path = findSourceRoute(destination);
+    for (int i = 0; !path && i < _sourceRoutes.size; i++) {
+        if (!_sourceRoutes[i].valid) {
+            path = &_sourceRoutes[i];
+        }
+    }
+    if (!path) {
+        path = &_sourceRoutes[0];
+        for (int i = 1; i < _sourceRoutes.size; i++) {
+            if (_sourceRoutes[i].lastSeenAge > path->lastSeenAge) {
+                path = &_sourceRoutes[i];
+            }
+        }
+    }
+    
+    path->destination = destination;
+    path->length = length;
+    for (uint8_t i = 0; i < length; i++) {
+        path->hops[i] = reversed ? hops[length - 1 - i] : hops[i];
+    }
+    path->valid = 1;
+    path->lastSeenAge = 0;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::clearSourceRoute(uint8_t destination) {
+    SourceRoute* path = findSourceRoute(destination);
+    if (path) {
+        path->valid = 0;
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::applySourceRoute(Header& header, uint8_t len) {
+    if (!sourceRoutingActive()) {
+        return false;
+    }
+    
+    // Data too long to carry the path goes by table instead
+    SourceRoute* path = findSourceRoute(header.destination);
+    uint8_t overhead = secureActive() ? LORAMESH_SECURE_OVERHEAD : 0;
+    if (!path || 8 + path->length + len + overhead > LORAMESH_MAX_FRAME_LEN) {
+        return false;
+    }
+    
+    memcpy(header.visitedNodes, path->hops, path->length);
+    header.visitedCount = path->length;
+    header.flags |= MESSAGE_FLAG_SOURCE_ROUTE;
+    return true;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setSourceRouting(bool enabled) {
+    _sourceRouting = enabled;
+    if (!enabled) {
+        for (int i = 0; i < _sourceRoutes.size; i++) {
+            _sourceRoutes[i].valid = 0;
+        }
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::joinGroup(uint8_t group) {
+    if (!multicastActive() || !isGroupAddress(group)) {
+        return false;
+    }
+    uint16_t bit = (uint16_t)1 << (group - LORAMESH_GROUP_BASE);
+    if (!(_groupMask & bit)) {
+        _groupMask |= bit;
+        _groupReport = 1;
+    }
+    return true;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::leaveGroup(uint8_t group) {
+    if (!isGroupAddress(group)) {
+        return;
+    }
+    uint16_t bit = (uint16_t)1 << (group - LORAMESH_GROUP_BASE);
+    if (_groupMask & bit) {
+        _groupMask &= ~bit;
+        _groupReport = 1;
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::isGroupMember(uint8_t group) {
+    return isGroupAddress(group) && (_groupMask & ((uint16_t)1 << (group - LORAMESH_GROUP_BASE)));
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getGroupMembers(uint8_t group, uint8_t* members, uint8_t maxMembers) {
+    if (!isGroupAddress(group)) {
+        return 0;
+    }
+    uint16_t bit = (uint16_t)1 << (group - LORAMESH_GROUP_BASE);
+    uint8_t count = 0;
+    for (int i = 0; i < _groupMembers.size && count < maxMembers; i++) {
+        if (_groupMembers[i].valid && (_groupMembers[i].groups & bit)) {
+            members[count++] = _groupMembers[i].address;
+        }
+    }
+    return count;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getMaxGroupMessageLen() {
+    // Header with a full path, member count and list, security trailer
+    return LORAMESH_MAX_FRAME_LEN - 9 - Config::maxHops - Config::groupMemberTableSize - LORAMESH_SECURE_OVERHEAD;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::sendToGroup(uint8_t group, const uint8_t* data, uint8_t len) {
+    if (len > getMaxGroupMessageLen()) {
+        return false;
+    }
+    
+    uint8_t members[Config::groupMemberTableSize];
+    uint8_t count = getGroupMembers(group, members, Config::groupMemberTableSize);
+    if (count == 0) {
+        return false;
+    }
+    
+    Header header;
+    header.destination = group;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_MULTICAST;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    return forwardToGroup(header, members, count, data, len);
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::forwardToGroup(Header& header, const uint8_t* members, uint8_t count, const uint8_t* data, uint8_t len) {
+    // One frame per distinct next hop, listing only the members behind it, so
+    // copies are made only where the paths to the members diverge
+    uint8_t payload[LORAMESH_MAX_MESSAGE_LEN];
+    bool delivered = true;
+    
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t nextHop = getGroupNextHop(members[i]);
+        
+        // Members behind an earlier member's next hop already went in its branch
+        bool covered = false;
+        for (uint8_t j = 0; j < i && !covered; j++) {
+            covered = getGroupNextHop(members[j]) == nextHop;
+        }
+        if (covered) {
+            continue;
+        }
+        
+        // No known way on, or a branch that would turn back along the path
+        if (nextHop == LORAMESH_BROADCAST_ADDRESS || nextHop == header.source ||
+            isNodeVisited(header, nextHop) || header.visitedCount >= Config::maxHops) {
+            delivered = false;
+            continue;
+        }
+        
+        uint8_t branchCount = 0;
+        for (uint8_t j = i; j < count; j++) {
+            if (getGroupNextHop(members[j]) == nextHop) {
+                payload[1 + branchCount++] = members[j];
+            }
+        }
+        if (1 + branchCount + len > LORAMESH_MAX_MESSAGE_LEN) {
+            delivered = false;
+            continue;
+        }
+        payload[0] = branchCount;
+        memcpy(&payload[1 + branchCount], data, len);
+        
+        Header branch = header;
+        branch.visitedNodes[branch.visitedCount++] = nextHop;
+        if (!sendPacketWithAck(branch, payload, 1 + branchCount + len)) {
+            // Use the routing table for these members until they report again
+            for (uint8_t j = 1; j <= branchCount; j++) {
+                GroupMember* member = findGroupMember(payload[j]);
+                if (member && member->nextHop == nextHop) {
+                    member->nextHop = LORAMESH_BROADCAST_ADDRESS;
+                }
+            }
+            delivered = false;
+        }
+    }
+    return delivered;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getGroupNextHop(uint8_t member) {
+    // A live unicast route reflects repairs since the member's last report
+    RoutingEntry* route = findRoute(member);
+    if (route && route->state == ROUTE_STATE_VALID) {
+        return route->nextHop;
+    }
+    GroupMember* entry = findGroupMember(member);
+    return entry ? entry->nextHop : LORAMESH_BROADCAST_ADDRESS;
+}
+
+template <class Config>
+GroupMember* LoRaMeshT<Config>::findGroupMember(uint8_t address) {
+    for (int i = 0; i < _groupMembers.size; i++) {
+        if (_groupMembers[i].valid && _groupMembers[i].address == address) {
+            return &_groupMembers[i];
+        }
+    }
+    return NULL;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleGroupReport(Header& header, uint8_t* data, uint8_t len) {
+    if (!multicastActive() || len < 2 || header.source == _address ||
+        header.visitedCount == 0 || isNodeVisited(header, _address)) {
+        return;
+    }
+    
+    // The report flood doubles as a route request from the member
+    extractRoutesFromPath(header, true);
+    
+    uint16_t groups = data[0] | ((uint16_t)data[1] << 8);
+    uint8_t transmitter = header.visitedNodes[header.visitedCount - 1];
+    bool fresh = !isDuplicateMessage(header.source, header.messageId);
+    
+    GroupMember* member = findGroupMember(header.source);
+    if (fresh && groups == 0) {
+        // Left every group
+        if (member) {
+            member->valid = 0;
+        }
+    } else if (fresh) {
+        // Reuse the member's slot, else a free one, else the oldest entry
+        for (int i = 0; !member && i < _groupMembers.size; i++) {
+            if (!_groupMembers[i].valid) {
+                member = &_groupMembers[i];
+            }
+        }
+        if (!member) {
+            member = &_groupMembers[0];
+            for (int i = 1; i < _groupMembers.size; i++) {
+                if (_groupMembers[i].lastSeenAge > member->lastSeenAge) {
+                    member = &_groupMembers[i];
+                }
+            }
+        }
+        
+        member->address = header.source;
+        member->groups = groups;
+        member->nextHop = transmitter;
+        member->hopCount = header.visitedCount;
+        member->valid = 1;
+        member->lastSeenAge = 0;
+    } else if (member && header.visitedCount < member->hopCount) {
+        // A later copy of the report took a shorter path
+        member->nextHop = transmitter;
+        member->hopCount = header.visitedCount;
+    }
+    
+    // Flood the first copy on; sendPacket appends us to the path
+    if (fresh && header.visitedCount < Config::maxHops) {
+        sendPacket(header, data, len);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleMulticastMessage(Header& header, uint8_t* data, uint8_t len) {
+    if (!multicastActive()) {
+        return;
+    }
+    
+    // The transmitter is the path entry before us, or the originator
+    uint8_t previousHop = header.visitedCount > 1 ? header.visitedNodes[header.visitedCount - 2] : header.source;
+    sendAck(previousHop, header.messageId, true);
+    
+    if (header.source == _address || isDuplicateMessage(header.source, header.messageId)) {
+        return;
+    }
+    if (len < 1 || len < 1 + data[0]) {
+        return;
+    }
+    
+    uint8_t count = data[0];
+    uint8_t* members = &data[1];
+    uint8_t* payload = &data[1 + count];
+    uint8_t payloadLen = len - 1 - count;
+    
+    // Take ourselves off the member list; the rest is ours to pass on
+    bool listed = false;
+    for (uint8_t i = 0; i < count; i++) {
+        if (members[i] == _address) {
+            members[i] = members[--count];
+            listed = true;
+            break;
+        }
+    }
+    
+    if (listed && isGroupMember(header.destination)) {
+        // Buffered like data; recvFromAck reports the group as destination
+        Header delivery = header;
+        delivery.messageType = MESSAGE_TYPE_DATA;
+        addToMessageBuffer(delivery, payload, payloadLen);
+    }
+    
+    if (count > 0) {
+        header.hopCount++;
+        forwardToGroup(header, members, count, payload, payloadLen);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendGroupReport() {
+    Header header;
+    header.destination = LORAMESH_BROADCAST_ADDRESS;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_GROUP_REPORT;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    // The full membership, so a report without a group is the leave
+    uint8_t reportData[2] = {(uint8_t)_groupMask, (uint8_t)(_groupMask >> 8)};
+    if (sendPacket(header, reportData, 2)) {
+        _groupReport = 0;
+        _groupReportTime = millis();
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::processGroups() {
+    if (!_radioStarted) {
+        return;
+    }
+    if (_groupReport || (_groupMask && millis() - _groupReportTime >= LORAMESH_GROUP_REFRESH)) {
+        sendGroupReport();
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setDisseminationBuffer(uint8_t* buffer, uint16_t capacity) {
+    if (!Config::dissemination) {
+        return;
+    }
+    
+    _dissemination->buffer = buffer;
+    _dissemination->capacity = capacity;
+    _dissemination->version = 0;
+    _dissemination->length = 0;
+    _dissemination->source = LORAMESH_BROADCAST_ADDRESS;
+    _dissemination->complete = 0;
+    _dissemination->updated = 0;
+    _dissemination->requestTime = 0;
+    _dissemination->sendTime = 0;
+    memset(_dissemination->held, 0, sizeof(_dissemination->held));
+    memset(_dissemination->requested, 0, sizeof(_dissemination->requested));
+    
+    // Advertise version 0 at once, so neighbors holding data answer quickly
+    _dissemination->doublings = 0;
+    startTrickleInterval();
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::disseminate(const uint8_t* data, uint16_t len) {
+    if (!disseminationActive() || len == 0 || len > _dissemination->capacity ||
+        ((uint32_t)len + LORAMESH_CHUNK_LEN - 1) / LORAMESH_CHUNK_LEN > Config::maxChunks) {
+        return false;
+    }
+    
+    if (data != _dissemination->buffer) {
+        memcpy(_dissemination->buffer, data, len);
+    }
+    
+    // Version 0 means nothing held, so it is skipped when the counter wraps
+    uint16_t version = _dissemination->version + 1;
+    _dissemination->version = version ? version : 1;
+    _dissemination->length = len;
+    _dissemination->source = _address;
+    _dissemination->complete = 1;
+    _dissemination->updated = 0;
+    memset(_dissemination->held, 0xFF, sizeof(_dissemination->held));
+    memset(_dissemination->requested, 0, sizeof(_dissemination->requested));
+    resetTrickle();
+    return true;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::disseminationUpdated(uint16_t* version, uint16_t* len) {
+    if (!Config::dissemination || !_dissemination->updated) {
+        return false;
+    }
+    _dissemination->updated = 0;
+    if (version) *version = _dissemination->version;
+    if (len) *len = _dissemination->length;
+    return true;
+}
+
+template <class Config>
+uint16_t LoRaMeshT<Config>::getDisseminationVersion() {
+    return Config::dissemination && _dissemination->complete ? _dissemination->version : 0;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getChunkCount() {
+    return ((uint32_t)_dissemination->length + LORAMESH_CHUNK_LEN - 1) / LORAMESH_CHUNK_LEN;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleSummary(Header& header, uint8_t* data, uint8_t len) {
+    if (!disseminationActive() || len < 5) {
+        return;
+    }
+    
+    uint16_t version = data[0] | ((uint16_t)data[1] << 8);
+    uint16_t length = data[2] | ((uint16_t)data[3] << 8);
+    bool complete = data[4];
+    int16_t difference = (int16_t)(version - _dissemination->version);
+    
+    if (difference > 0) {
+        // A newer version: drop ours and fetch it
+        if (adoptVersion(version, length) && complete) {
+            _dissemination->source = header.source;
+        }
+    } else if (difference < 0) {
+        // The neighbor is behind: advertise soon so it can catch up
+        resetTrickle();
+    } else if (complete && _dissemination->complete) {
+        _dissemination->counter++;
+    } else if (complete) {
+        _dissemination->source = header.source;
+    } else if (_dissemination->complete) {
+        resetTrickle();
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleChunkRequest(Header& header, uint8_t* data, uint8_t len) {
+    // Our own request relayed back to us needs no answer
+    if (!disseminationActive() || len < 3 || header.source == _address) {
+        return;
+    }
+    
+    uint16_t version = data[0] | ((uint16_t)data[1] << 8);
+    if (version != _dissemination->version) {
+        if ((int16_t)(version - _dissemination->version) < 0) {
+            resetTrickle();
+        }
+        return;
+    }
+    if (data[2] != _address || !_dissemination->complete) {
+        return;
+    }
+    
+    bool idle = true;
+    for (uint8_t i = 0; i < sizeof(_dissemination->requested); i++) {
+        idle = idle && !_dissemination->requested[i];
+        if (3 + i < len) {
+            _dissemination->requested[i] |= data[3 + i];
+        }
+    }
+    if (idle) {
+        _dissemination->sendTime = millis() + random(LORAMESH_CHUNK_SPACING);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleChunk(Header& header, uint8_t* data, uint8_t len) {
+    if (!disseminationActive() || len < 5) {
+        return;
+    }
+    
+    uint16_t version = data[0] | ((uint16_t)data[1] << 8);
+    uint16_t length = data[2] | ((uint16_t)data[3] << 8);
+    uint8_t index = data[4];
+    int16_t difference = (int16_t)(version - _dissemination->version);
+    
+    if (difference < 0) {
+        resetTrickle();
+        return;
+    }
+    if (difference > 0 && !adoptVersion(version, length)) {
+        return;
+    }
+    if (index >= Config::maxChunks || length != _dissemination->length) {
+        return;
+    }
+    
+    // Someone else answered: leave this chunk out of what we send
+    _dissemination->requested[index / 8] &= ~(1 << (index % 8));
+    
+    // Only complete holders send chunks
+    _dissemination->source = header.source;
+    
+    if (_dissemination->complete || index >= getChunkCount() ||
+        (_dissemination->held[index / 8] & (1 << (index % 8)))) {
+        return;
+    }
+    
+    uint16_t offset = (uint16_t)index * LORAMESH_CHUNK_LEN;
+    uint16_t expected = min((uint16_t)LORAMESH_CHUNK_LEN, (uint16_t)(length - offset));
+    if (len - 5 != expected) {
+        return;
+    }
+    
+    memcpy(&_dissemination->buffer[offset], &data[5], expected);
+    _dissemination->held[index / 8] |= 1 << (index % 8);
+    
+    // Chunks are still flowing: hold the next request back
+    _dissemination->requestTime = millis();
+    
+    for (uint8_t i = 0; i < getChunkCount(); i++) {
+        if (!(_dissemination->held[i / 8] & (1 << (i % 8)))) {
+            return;
+        }
+    }
+    _dissemination->complete = 1;
+    _dissemination->updated = 1;
+    resetTrickle();
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::adoptVersion(uint16_t version, uint16_t length) {
+    // The object must fit both the buffer and the chunk bitmap
+    if (length == 0 || length > _dissemination->capacity ||
+        ((uint32_t)length + LORAMESH_CHUNK_LEN - 1) / LORAMESH_CHUNK_LEN > Config::maxChunks) {
+        return false;
+    }
+    
+    _dissemination->version = version;
+    _dissemination->length = length;
+    _dissemination->source = LORAMESH_BROADCAST_ADDRESS;
+    _dissemination->complete = 0;
+    _dissemination->updated = 0;
+    memset(_dissemination->held, 0, sizeof(_dissemination->held));
+    memset(_dissemination->requested, 0, sizeof(_dissemination->requested));
+    
+    // First request after a random delay, so neighbors that heard the same
+    // summary do not all ask at once
+    _dissemination->requestTime = millis() - LORAMESH_CHUNK_REQUEST_INTERVAL + random(LORAMESH_TRICKLE_IMIN / 2);
+    resetTrickle();
+    return true;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendSummary() {
+    Header header;
+    header.destination = LORAMESH_BROADCAST_ADDRESS;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_SUMMARY;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    uint8_t summary[5] = {
+        (uint8_t)_dissemination->version, (uint8_t)(_dissemination->version >> 8),
+        (uint8_t)_dissemination->length, (uint8_t)(_dissemination->length >> 8),
+        _dissemination->complete
+    };
+    sendPacket(header, summary, 5);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendChunkRequest() {
+    Header header;
+    header.destination = LORAMESH_BROADCAST_ADDRESS;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_CHUNK_REQUEST;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    // Version, the holder asked, and a bitmap of the missing chunks
+    uint8_t count = getChunkCount();
+    uint8_t bytes = (count + 7) / 8;
+    uint8_t request[3 + sizeof(_dissemination->held)];
+    request[0] = _dissemination->version;
+    request[1] = _dissemination->version >> 8;
+    request[2] = _dissemination->source;
+    for (uint8_t i = 0; i < bytes; i++) {
+        request[3 + i] = ~_dissemination->held[i];
+    }
+    if (count % 8) {
+        request[2 + bytes] &= (1 << (count % 8)) - 1;
+    }
+    
+    sendPacket(header, request, 3 + bytes);
+    _dissemination->requestTime = millis();
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendChunk(uint8_t index) {
+    Header header;
+    header.destination = LORAMESH_BROADCAST_ADDRESS;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_CHUNK;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    uint16_t offset = (uint16_t)index * LORAMESH_CHUNK_LEN;
+    uint8_t size = min((uint16_t)LORAMESH_CHUNK_LEN, (uint16_t)(_dissemination->length - offset));
+    
+    uint8_t chunk[5 + LORAMESH_CHUNK_LEN];
+    chunk[0] = _dissemination->version;
+    chunk[1] = _dissemination->version >> 8;
+    chunk[2] = _dissemination->length;
+    chunk[3] = _dissemination->length >> 8;
+    chunk[4] = index;
+    memcpy(&chunk[5], &_dissemination->buffer[offset], size);
+    sendPacket(header, chunk, 5 + size);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::resetTrickle() {
+    // Inconsistency or new data: back to the shortest interval, unless already there
+    if (_dissemination->doublings != 0) {
+        _dissemination->doublings = 0;
+        startTrickleInterval();
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::startTrickleInterval() {
+    // Our summary goes out at a random point in the second half of the interval
+    unsigned long interval = (unsigned long)LORAMESH_TRICKLE_IMIN << _dissemination->doublings;
+    _dissemination->intervalStart = millis();
+    _dissemination->fireDelay = interval / 2 + random(interval / 2);
+    _dissemination->counter = 0;
+    _dissemination->fired = 0;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::processDissemination() {
+    if (!_radioStarted) {
+        return;
+    }
+    
+    unsigned long now = millis();
+    if (!_dissemination->fired && now - _dissemination->intervalStart >= _dissemination->fireDelay) {
+        // Suppressed when enough neighbors already advertised the same version
+        _dissemination->fired = 1;
+        if (_dissemination->counter < LORAMESH_TRICKLE_K) {
+            sendSummary();
+        }
+    }
+    if (now - _dissemination->intervalStart >= ((unsigned long)LORAMESH_TRICKLE_IMIN << _dissemination->doublings)) {
+        if (_dissemination->doublings < LORAMESH_TRICKLE_DOUBLINGS) {
+            _dissemination->doublings++;
+        }
+        startTrickleInterval();
+    }
+    
+    // Ask the last holder heard from for whatever is still missing
+    if (!_dissemination->complete && _dissemination->version != 0 &&
+        _dissemination->source != LORAMESH_BROADCAST_ADDRESS &&
+        now - _dissemination->requestTime >= LORAMESH_CHUNK_REQUEST_INTERVAL) {
+        sendChunkRequest();
+    }
+    
+    // Serve requested chunks one per call, so frames are still received in between
+    if (_dissemination->complete && (long)(now - _dissemination->sendTime) >= 0) {
+        for (uint8_t i = 0; i < getChunkCount(); i++) {
+            if (_dissemination->requested[i / 8] & (1 << (i % 8))) {
+                _dissemination->requested[i / 8] &= ~(1 << (i % 8));
+                sendChunk(i);
+                _dissemination->sendTime = millis() + random(LORAMESH_CHUNK_SPACING);
+                break;
+            }
+        }
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setPosition(int32_t x, int32_t y) {
+    _positionX = x;
+    _positionY = y;
+    
+    // Beacon soon so neighbors can pick us as a greedy next hop
+    if (!_positionSet) {
+        _positionBeaconTime = millis() + random(LORAMESH_POSITION_JITTER);
+    }
+    _positionSet = 1;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::setNodePosition(uint8_t address, int32_t x, int32_t y) {
+    NodePosition* position = learnPosition(address, x, y, false);
+    if (!position) {
+        return false;
+    }
+    position->fixed = 1;
+    return true;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::getNodePosition(uint8_t address, int32_t* x, int32_t* y) {
+    if (address == _address && _positionSet) {
+        *x = _positionX;
+        *y = _positionY;
+        return true;
+    }
+    NodePosition* position = findPosition(address);
+    if (!position) {
+        return false;
+    }
+    *x = position->x;
+    *y = position->y;
+    return true;
+}
+
+template <class Config>
+NodePosition* LoRaMeshT<Config>::getPositionTable() {
+    return _positions.data();
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getPositionTableSize() {
+    return _positions.size;
+}
+
+template <class Config>
+NodePosition* LoRaMeshT<Config>::findPosition(uint8_t address) {
+    for (int i = 0; i < _positions.size; i++) {
+        if (_positions[i].valid && _positions[i].address == address) {
+            return &_positions[i];
+        }
+    }
+    return NULL;
+}
+
+template <class Config>
+NodePosition* LoRaMeshT<Config>::learnPosition(uint8_t address, int32_t x, int32_t y, bool neighbor) {
+    if (address == _address || address == LORAMESH_BROADCAST_ADDRESS || isGroupAddress(address)) {
+        return NULL;
+    }
+    
+    NodePosition* position = findPosition(address);
+    if (!position) {
+        // A free slot, otherwise the stalest position the sketch did not set
+        uint16_t oldestAge = 0;
+        for (int i = 0; i < _positions.size; i++) {
+            if (!_positions[i].valid) {
+                position = &_positions[i];
+                break;
+            }
+            if (!_positions[i].fixed && (!position || _positions[i].lastSeenAge > oldestAge)) {
+                oldestAge = _positions[i].lastSeenAge;
+                position = &_positions[i];
+            }
+        }
+        if (!position) {
+            return NULL;
+        }
+        position->address = address;
+        position->valid = 1;
+        position->neighbor = 0;
+        position->fixed = 0;
+        position->failed = 0;
+    }
+    
+    position->x = x;
+    position->y = y;
+    position->neighbor |= neighbor;
+    position->lastSeenAge = 0;
+    return position;
+}
+
+template <class Config>
+float LoRaMeshT<Config>::getDistance(int32_t x, int32_t y, int32_t targetX, int32_t targetY) {
+    // Squared distance; only ever compared
+    float dx = (float)targetX - x;
+    float dy = (float)targetY - y;
+    return dx * dx + dy * dy;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::putCoordinate(uint8_t* buffer, int32_t value) {
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+template <class Config>
+int32_t LoRaMeshT<Config>::getCoordinate(const uint8_t* buffer) {
+    return (int32_t)((uint32_t)buffer[0] | ((uint32_t)buffer[1] << 8) |
+                     ((uint32_t)buffer[2] << 16) | ((uint32_t)buffer[3] << 24));
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getGeoNextHop(Header& header, int32_t x, int32_t y) {
+    // The destination itself when it is in range
+    NodePosition* position = findPosition(header.destination);
+    RoutingEntry* route = findRoute(header.destination);
+    if ((position && position->neighbor) ||
+        (route && route->state == ROUTE_STATE_VALID && route->hopCount == 1)) {
+        return header.destination;
+    }
+    if (!geoActive()) {
+        return LORAMESH_BROADCAST_ADDRESS;
+    }
+    
+    // Greedy step: the neighbor closest to the destination, if closer than us;
+    // nodes already on the path are skipped so the frame cannot circle
+    uint8_t nextHop = LORAMESH_BROADCAST_ADDRESS;
+    float best = getDistance(_positionX, _positionY, x, y);
+    for (int i = 0; i < _positions.size; i++) {
+        position = &_positions[i];
+        if (!position->valid || !position->neighbor || position->address == header.source ||
+            isNodeVisited(header, position->address)) {
+            continue;
+        }
+        float distance = getDistance(position->x, position->y, x, y);
+        if (distance < best) {
+            best = distance;
+            nextHop = position->address;
+        }
+    }
+    return nextHop;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::applyGeoRoute(Header& header, uint8_t len) {
+    if (!geoActive()) {
+        return false;
+    }
+    
+    // Room for coordinates and a full path, and a position that worked lately
+    uint8_t overhead = secureActive() ? LORAMESH_SECURE_OVERHEAD : 0;
+    NodePosition* position = findPosition(header.destination);
+    if (!position || position->failed ||
+        8 + Config::maxHops + LORAMESH_GEO_OVERHEAD + len + overhead > LORAMESH_MAX_FRAME_LEN) {
+        return false;
+    }
+    
+    uint8_t nextHop = getGeoNextHop(header, position->x, position->y);
+    if (nextHop == LORAMESH_BROADCAST_ADDRESS) {
+        return false;
+    }
+    
+    header.messageType = MESSAGE_TYPE_GEO_DATA;
+    header.flags &= ~MESSAGE_FLAG_SOURCE_ROUTE;
+    header.visitedNodes[0] = nextHop;
+    header.visitedCount = 1;
+    return true;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::sendGeo(Header& header, const uint8_t* data, uint8_t len) {
+    NodePosition* position = findPosition(header.destination);
+    if (!position) {
+        return false;
+    }
+    
+    // Destination and source coordinates, then the data
+    uint8_t payload[LORAMESH_MAX_MESSAGE_LEN];
+    putCoordinate(&payload[0], position->x);
+    putCoordinate(&payload[4], position->y);
+    putCoordinate(&payload[8], _positionX);
+    putCoordinate(&payload[12], _positionY);
+    memcpy(&payload[LORAMESH_GEO_OVERHEAD], data, len);
+    return sendPacketWithAck(header, payload, LORAMESH_GEO_OVERHEAD + len);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handlePosition(Header& header, uint8_t* data, uint8_t len) {
+    if (!Config::geographicRouting || len < 8 || header.hopCount != 1) {
+        return;
+    }
+    
+    bool known = findPosition(header.source) && findPosition(header.source)->neighbor;
+    learnPosition(header.source, getCoordinate(&data[0]), getCoordinate(&data[4]), true);
+    
+    // Answer a newcomer early, so it learns its neighbors without a full refresh
+    if (!known && geoActive() && (long)(_positionBeaconTime - millis()) > LORAMESH_POSITION_JITTER) {
+        _positionBeaconTime = millis() + random(LORAMESH_POSITION_JITTER);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleGeoMessage(Header& header, uint8_t* data, uint8_t len) {
+    if (!Config::geographicRouting || header.visitedCount == 0) {
+        return;
+    }
+    
+    bool relay = header.destination != _address;
+    uint8_t congestion = LORAMESH_CONGESTION_NONE;
+    if (flowControlActive() && header.source != _address) {
+        congestion = getCongestion(relay);
+    }
+    
+    // The transmitter is the path entry before us, or the originator
+    uint8_t previousHop = header.visitedCount > 1 ? header.visitedNodes[header.visitedCount - 2] : header.source;
+    sendAck(previousHop, header.messageId, true, congestion);
+    if (congestion == LORAMESH_CONGESTION_FULL) {
+        traceEvent(TRACE_DROP, header, LORAMESH_BROADCAST_ADDRESS, TRACE_DROP_CONGESTED);
+        return;
+    }
+    
+    if (header.source == _address || isDuplicateMessage(header.source, header.messageId)) {
+        return;
+    }
+    if (len < LORAMESH_GEO_OVERHEAD) {
+        return;
+    }
+    
+    // The way back and the source's position, so replies need no flood either
+    updateRoutingTable(header.source, previousHop, header.visitedCount);
+    learnPosition(header.source, getCoordinate(&data[8]), getCoordinate(&data[12]), false);
+    
+    if (!relay) {
+        // Buffered like data
+        Header delivery = header;
+        delivery.messageType = MESSAGE_TYPE_DATA;
+        addToMessageBuffer(delivery, &data[LORAMESH_GEO_OVERHEAD], len - LORAMESH_GEO_OVERHEAD);
+        if (header.flags & MESSAGE_FLAG_RECEIPT) {
+            queueReceipt(header.source, header.messageId);
+        }
+        return;
+    }
+    
+    // At a local minimum, a table route may still lead around the void
+    uint8_t nextHop = getGeoNextHop(header, getCoordinate(&data[0]), getCoordinate(&data[4]));
+    RoutingEntry* route = findRoute(header.destination);
+    if (nextHop == LORAMESH_BROADCAST_ADDRESS && route && route->state == ROUTE_STATE_VALID &&
+        !isNodeVisited(header, route->nextHop)) {
+        nextHop = route->nextHop;
+    }
+    
+    if (nextHop == LORAMESH_BROADCAST_ADDRESS || header.visitedCount >= Config::maxHops) {
+        // Stuck: the source falls back to route discovery
+        Header failureHeader;
+        failureHeader.destination = header.source;
+        failureHeader.source = _address;
+        failureHeader.messageId = getNextMessageId();
+        failureHeader.messageType = MESSAGE_TYPE_ROUTE_FAILURE;
+        failureHeader.flags = 0;
+        failureHeader.hopCount = 0;
+        failureHeader.visitedCount = 0;
+        
+        uint8_t failureData[1] = {header.destination};
+        sendPacket(failureHeader, failureData, 1);
+        return;
+    }
+    
+    header.hopCount++;
+    header.visitedNodes[header.visitedCount++] = nextHop;
+    if (flowControlActive()) {
+        queueForward(header, data, len);
+    } else {
+        sendPacketWithAck(header, data, len);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendPositionBeacon() {
+    Header header;
+    header.destination = LORAMESH_BROADCAST_ADDRESS;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_POSITION;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    uint8_t beacon[8];
+    putCoordinate(&beacon[0], _positionX);
+    putCoordinate(&beacon[4], _positionY);
+    sendPacket(header, beacon, 8);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::processPositions() {
+    if (!_radioStarted || (long)(millis() - _positionBeaconTime) < 0) {
+        return;
+    }
+    
+    sendPositionBeacon();
+    _positionBeaconTime = millis() + LORAMESH_POSITION_REFRESH + random(LORAMESH_POSITION_JITTER);
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::startRouteDiscovery(uint8_t destination) {
+    // Check if there's an active route discovery
+    if (_routeDiscovery.active) {
+        // If the current discovery has timed out, clear it
+        if (isAgeExpired(_routeDiscovery.startTimeAge, LORAMESH_ROUTE_DISCOVERY_TIMEOUT / 1000)) {
+            _routeDiscovery.active = 0;
+            // Clear the route state if it's still discovering
+            RoutingEntry* route = findRoute(_routeDiscovery.destination);
+            if (route && route->state == ROUTE_STATE_DISCOVERING) {
+                route->state = ROUTE_STATE_INVALID;
+            }
+        } else if (_routeDiscovery.destination == destination) {
+            // Already discovering this destination
+            return true;
+        } else {
+            // Different destination requested while another is active
+            return false;
+        }
+    }
+    
+    Header header;
+    header.destination = destination;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_ROUTE_REQUEST;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    
+    _routeDiscovery.destination = destination;
+    _routeDiscovery.startTimeAge = 0;
+    _routeDiscovery.messageId = header.messageId;
+    _routeDiscovery.active = 1;
+    
+    RoutingEntry* route = findRoute(destination);
+    if (!route) {
+        for (int i = 0; i < Config::routingTableSize; i++) {
+            if (_routingTable[i].state == ROUTE_STATE_INVALID) {
+                route = &_routingTable[i];
+                break;
+            }
+        }
+    }
+    
+    if (route) {
+        route->destination = destination;
+        route->state = ROUTE_STATE_DISCOVERING;
+        route->lastSeenAge = 0;
+    }
+    
+    traceEvent(TRACE_DISCOVERY_START, header, LORAMESH_BROADCAST_ADDRESS);
+    uint8_t emptyData[1] = {0};
+    return sendPacket(header, emptyData, 0);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::updateRoutingTable(uint8_t destination, uint8_t nextHop, uint8_t hopCount) {
+    RoutingEntry* route = findRoute(destination);
+    
+    if (!route) {
+        for (int i = 0; i < Config::routingTableSize; i++) {
+            if (_routingTable[i].state == ROUTE_STATE_INVALID) {
+                route = &_routingTable[i];
+                break;
+            }
+        }
+        
+        if (!route) {
+            uint16_t oldestAge = 0;
+            int oldestIndex = 0;
+            for (int i = 0; i < Config::routingTableSize; i++) {
+                if (_routingTable[i].lastSeenAge > oldestAge) {
+                    oldestAge = _routingTable[i].lastSeenAge;
+                    oldestIndex = i;
+                }
+            }
+            route = &_routingTable[oldestIndex];
+        }
+    }
+    
+    if (route) {
+        route->destination = destination;
+        route->nextHop = nextHop;
+        route->hopCount = hopCount;
+        route->state = ROUTE_STATE_VALID;
+        route->lastSeenAge = 0;
+    }
+}
+
+template <class Config>
+RoutingEntry* LoRaMeshT<Config>::findRoute(uint8_t destination) {
+    for (int i = 0; i < Config::routingTableSize; i++) {
+        if (_routingTable[i].destination == destination && 
+            _routingTable[i].state != ROUTE_STATE_INVALID) {
+            return &_routingTable[i];
+        }
+    }
+    return NULL;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::clearRoute(uint8_t destination) {
+    RoutingEntry* route = findRoute(destination);
+    if (route) {
+        route->state = ROUTE_STATE_INVALID;
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::cleanupRoutingTable() {
+    for (int i = 0; i < Config::routingTableSize; i++) {
+        if (_routingTable[i].state == ROUTE_STATE_VALID &&
+            isAgeExpired(_routingTable[i].lastSeenAge, LORAMESH_ROUTE_TIMEOUT / 1000)) {
+            _routingTable[i].state = ROUTE_STATE_INVALID;
+        }
+        // Update age for all entries
+        if (_routingTable[i].state != ROUTE_STATE_INVALID) {
+            _routingTable[i].lastSeenAge = min(_routingTable[i].lastSeenAge + 1, 65535);
+        }
+    }
+    
+    for (int i = 0; i < _sourceRoutes.size; i++) {
+        if (_sourceRoutes[i].valid &&
+            isAgeExpired(_sourceRoutes[i].lastSeenAge, LORAMESH_SOURCE_ROUTE_TIMEOUT / 1000)) {
+            _sourceRoutes[i].valid = 0;
+        }
+        if (_sourceRoutes[i].valid) {
+            _sourceRoutes[i].lastSeenAge = min(_sourceRoutes[i].lastSeenAge + 1, 65535);
+        }
+    }
+    
+    // Group members that stopped reporting have left or gone away
+    for (int i = 0; i < _groupMembers.size; i++) {
+        if (_groupMembers[i].valid &&
+            isAgeExpired(_groupMembers[i].lastSeenAge, LORAMESH_GROUP_TIMEOUT / 1000)) {
+            _groupMembers[i].valid = 0;
+        }
+        if (_groupMembers[i].valid) {
+            _groupMembers[i].lastSeenAge = min(_groupMembers[i].lastSeenAge + 1, 65535);
+        }
+    }
+    
+    // Learned positions expire; surveyed ones only lose their neighbor status
+    for (int i = 0; i < _positions.size; i++) {
+        NodePosition* position = &_positions[i];
+        if (!position->valid) {
+            continue;
+        }
+        if (isAgeExpired(position->lastSeenAge, LORAMESH_POSITION_TIMEOUT / 1000)) {
+            position->neighbor = 0;
+            position->valid = position->fixed;
+        }
+        position->lastSeenAge = min(position->lastSeenAge + 1, 65535);
+        if (position->failed) {
+            position->failed = !isAgeExpired(position->failureAge, LORAMESH_ROUTE_TIMEOUT / 1000);
+            position->failureAge = min(position->failureAge + 1, 65535);
+        }
+    }
+    
+    // Forget ADR state for neighbors we have not exchanged frames with recently
+    for (int i = 0; i < _neighborTable.size; i++) {
+        if (_neighborTable[i].valid &&
+            isAgeExpired(_neighborTable[i].lastSeenAge, LORAMESH_ROUTE_TIMEOUT / 1000)) {
+            _neighborTable[i].valid = 0;
+        }
+        if (_neighborTable[i].valid) {
+            _neighborTable[i].lastSeenAge = min(_neighborTable[i].lastSeenAge + 1, 65535);
+        }
+    }
+    
+    // Also check for timed out route discovery
+    if (_routeDiscovery.active && 
+        isAgeExpired(_routeDiscovery.startTimeAge, LORAMESH_ROUTE_DISCOVERY_TIMEOUT / 1000)) {
+        _routeDiscovery.active = 0;
+        // Clear the route state if it's still discovering
+        RoutingEntry* route = findRoute(_routeDiscovery.destination);
+        if (route && route->state == ROUTE_STATE_DISCOVERING) {
+            route->state = ROUTE_STATE_INVALID;
+        }
+    }
+    
+    // Update route discovery age
+    if (_routeDiscovery.active) {
+        _routeDiscovery.startTimeAge = min(_routeDiscovery.startTimeAge + 1, 65535);
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::isNodeVisited(Header& header, uint8_t node) {
+    for (uint8_t i = 0; i < header.visitedCount; i++) {
+        if (header.visitedNodes[i] == node) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::addVisitedNode(Header& header, uint8_t node) {
+    if (header.visitedCount < Config::maxHops && !isNodeVisited(header, node)) {
+        header.visitedNodes[header.visitedCount++] = node;
+    }
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getNextMessageId() {
+    if (persistActive() && _sequence >= _sequenceLease) {
+        persistCounters();
+    }
+    return (uint8_t)(_sequence++);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::traceFrame(uint8_t event, const uint8_t* frame, uint8_t frameLen, uint8_t arg) {
+    if (Config::traceBufferSize == 0) {
+        return;
+    }
+    
+    TraceRecord* record = _trace.add();
+    record->time = millis();
+    record->event = event;
+    record->destination = frame[0];
+    record->source = frame[1];
+    record->messageId = frame[2];
+    record->type = frame[3];
+    record->hopCount = frame[4];
+    record->nextHop = (6 + frame[5] < frameLen) ? frame[6 + frame[5]] : LORAMESH_BROADCAST_ADDRESS;
+    record->length = frameLen;
+    record->rssi = 0;
+    record->snr = 0;
+    record->arg = arg;
+    record->reserved = 0;
+    
+    if (event != TRACE_TX) {
+        int rssi = _radio->packetRssi();
+        record->rssi = rssi < -128 ? -128 : rssi;
+        record->snr = (int8_t)(_radio->packetSnr() * 4);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::traceEvent(uint8_t event, Header& header, uint8_t nextHop, uint8_t arg) {
+    if (Config::traceBufferSize == 0) {
+        return;
+    }
+    
+    TraceRecord* record = _trace.add();
+    record->time = millis();
+    record->event = event;
+    record->destination = header.destination;
+    record->source = header.source;
+    record->messageId = header.messageId;
+    record->type = header.messageType | header.flags;
+    record->hopCount = header.hopCount;
+    record->nextHop = nextHop;
+    record->length = 0;
+    record->rssi = 0;
+    record->snr = 0;
+    record->arg = arg;
+    record->reserved = 0;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::dumpTrace(Print& out) {
+    uint8_t count = _trace.count;
+    uint16_t lost = _trace.lost;
+    unsigned long now = millis();
+    
+    uint8_t header[LORAMESH_TRACE_HEADER_LEN] = {
+        'L', 'M', 'T', 'R', LORAMESH_TRACE_VERSION, _address, count, LORAMESH_TRACE_RECORD_LEN,
+        (uint8_t)lost, (uint8_t)(lost >> 8),
+        (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24)
+    };
+    out.write(header, sizeof(header));
+    
+    // Written field by field in little-endian order, whatever the MCU's struct layout
+    for (uint8_t i = 0; i < count; i++) {
+        TraceRecord* record = _trace.get(i);
+        uint8_t bytes[LORAMESH_TRACE_RECORD_LEN] = {
+            (uint8_t)record->time, (uint8_t)(record->time >> 8),
+            (uint8_t)(record->time >> 16), (uint8_t)(record->time >> 24),
+            record->event, record->destination, record->source, record->messageId,
+            record->type, record->hopCount, record->nextHop, record->length,
+            (uint8_t)record->rssi, (uint8_t)record->snr, record->arg, record->reserved
+        };
+        out.write(bytes, sizeof(bytes));
+    }
+    
+    _trace.clear();
+    return count;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getTraceCount() {
+    return _trace.count;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::clearTrace() {
+    _trace.clear();
+}
+
+template <class Config>
+RoutingEntry* LoRaMeshT<Config>::getRoutingTable() {
+    return _routingTable;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getRoutingTableSize() {
+    return Config::routingTableSize;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::printRoutingTable() {
+    Serial.println("=== Routing Table ===");
+    for (int i = 0; i < Config::routingTableSize; i++) {
+        if (_routingTable[i].state != ROUTE_STATE_INVALID) {
+            Serial.print("Dest: 0x");
+            Serial.print(_routingTable[i].destination, HEX);
+            Serial.print(" Next: 0x");
+            Serial.print(_routingTable[i].nextHop, HEX);
+            Serial.print(" Hops: ");
+            Serial.print(_routingTable[i].hopCount);
+            Serial.print(" State: ");
+            switch (_routingTable[i].state) {
+                case ROUTE_STATE_DISCOVERING:
+                    Serial.print("DISCOVERING");
+                    break;
+                case ROUTE_STATE_VALID:
+                    Serial.print("VALID");
+                    break;
+                default:
+                    Serial.print("INVALID");
+            }
+            Serial.println();
+        }
+    }
+    Serial.println("==================");
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setRetries(uint8_t retries) {
+    _retries = retries;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setRetryTimeout(uint16_t timeout) {
+    _retryTimeout = timeout;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendAck(uint8_t destination, uint8_t messageId, bool direct, uint8_t congestion) {
+    Header ackHeader;
+    ackHeader.destination = destination;
+    ackHeader.source = _address;
+    ackHeader.messageId = messageId;
+    ackHeader.messageType = MESSAGE_TYPE_ACK;
+    // An empty source route sends straight to a neighbor without a table entry
+    ackHeader.flags = direct ? MESSAGE_FLAG_SOURCE_ROUTE : 0;
+    ackHeader.hopCount = 0;
+    ackHeader.visitedCount = 0;
+    
+    // Report the SNR of the frame being acknowledged and the coding rate we
+    // would like the sender to use, so it can adapt its link settings
+    float snr = _radio->packetSnr();
+    int8_t reportedSnr = (int8_t)(snr < 0 ? snr - 0.5 : snr + 0.5);
+    uint8_t ackData[5] = {(uint8_t)reportedSnr, getPreferredCodingRate(reportedSnr), 0, 0, congestion};
+    
+    // Low-power listeners also tell the sender when they will next wake; a
+    // congestion report follows the wake delay, only when there is one
+    if (lplActive() || congestion != LORAMESH_CONGESTION_NONE) {
+        uint16_t wakeDelay = lplActive() && _lplSleep ? getNextWakeDelay() : LORAMESH_LPL_UNKNOWN_WAKE;
+        ackData[2] = wakeDelay & 0xFF;
+        ackData[3] = wakeDelay >> 8;
+        sendPacket(ackHeader, ackData, congestion != LORAMESH_CONGESTION_NONE ? 5 : 4);
+    } else {
+        sendPacket(ackHeader, ackData, 2);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sendHopAck(Header& header, uint8_t congestion) {
+    if (header.flags & MESSAGE_FLAG_SOURCE_ROUTE) {
+        // The transmitter is the path entry before us, or the originator
+        uint8_t previousHop = header.hopCount > 0 ? header.visitedNodes[header.hopCount - 1] : header.source;
+        sendAck(previousHop, header.messageId, true, congestion);
+    } else {
+        sendAck(header.source, header.messageId, false, congestion);
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::getNextHop(Header& header, uint8_t& nextHop) {
+    RoutingEntry* route;
+    if (header.messageType == MESSAGE_TYPE_MULTICAST || header.messageType == MESSAGE_TYPE_GEO_DATA) {
+        // Each sender appends the branch's or greedy step's next hop to the path
+        if (header.visitedCount == 0) {
+            return false;
+        }
+        nextHop = header.visitedNodes[header.visitedCount - 1];
+        return true;
+    }
+    
+    if (header.flags & MESSAGE_FLAG_SOURCE_ROUTE) {
+        // Stateless forwarding: hopCount indexes the next relay in the path
+        if (header.hopCount < header.visitedCount) {
+            nextHop = header.visitedNodes[header.hopCount];
+            return true;
+        }
+        
+        // Past the last relay: straight to the destination, unless this node
+        // still knows better or a bridge reaches it through another radio
+        route = findRoute(header.destination);
+        if (route && route->state == ROUTE_STATE_VALID) {
+            nextHop = route->nextHop;
+            return true;
+        }
+        if (_bridge && header.messageType != MESSAGE_TYPE_ACK) {
+            return false;
+        }
+        nextHop = header.destination;
+        return true;
+    }
+    
+    route = findRoute(header.destination);
+    if (!route || route->state != ROUTE_STATE_VALID) {
+        return false;
+    }
+    nextHop = route->nextHop;
+    return true;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleAck(Header& header, uint8_t* data, uint8_t len) {
+    if (_ackTracker.destination == header.source && 
+        _ackTracker.messageId == header.messageId) {
+        _ackTracker.ackReceived = 1;
+        
+        if (adrActive() && len >= 2) {
+            handleAdrReport(header.source, (int8_t)data[0], data[1]);
+        }
+        if (lplActive() && len >= 4) {
+            handleWakeReport(header.source, data[2] | ((uint16_t)data[3] << 8));
+        }
+        if (flowControlActive() && len >= 5) {
+            _ackTracker.congestion = data[4] > LORAMESH_CONGESTION_FULL ? LORAMESH_CONGESTION_BUSY : data[4];
+        }
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setSpreadingFactor(int sf) {
+    _spreadingFactor = sf;
+    if (_radioStarted) {
+        _radio->setSpreadingFactor(sf);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setSignalBandwidth(long sbw) {
+    _signalBandwidth = sbw;
+    if (_radioStarted) {
+        _radio->setSignalBandwidth(sbw);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setCodingRate4(int denominator) {
+    _codingRate = denominator;
+    if (_radioStarted) {
+        _radio->setCodingRate4(denominator);
+        _activeCodingRate = denominator;
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setTxPower(int level) {
+    _txPower = level;
+    if (_radioStarted) {
+        _radio->setTxPower(level);
+        _activeTxPower = level;
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setAdaptiveDataRate(bool enabled) {
+    _adrEnabled = enabled;
+    if (!enabled) {
+        for (int i = 0; i < _neighborTable.size; i++) {
+            _neighborTable[i].valid = 0;
+        }
+    }
+}
+
+template <class Config>
+NeighborLink* LoRaMeshT<Config>::getNeighborTable() {
+    return _neighborTable.data();
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getNeighborTableSize() {
+    return _neighborTable.size;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getTxAirtime() {
+    return _txAirtime;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getDeliveredBytes() {
+    return _deliveredBytes;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getEnergyPerDeliveredByte() {
+    if (_deliveredBytes == 0) {
+        return 0;
+    }
+    return _txEnergy / _deliveredBytes;
+}
+
+template <class Config>
+NeighborLink* LoRaMeshT<Config>::findNeighbor(uint8_t address) {
+    for (int i = 0; i < _neighborTable.size; i++) {
+        if (_neighborTable[i].valid && _neighborTable[i].address == address) {
+            return &_neighborTable[i];
+        }
+    }
+    return NULL;
+}
+
+template <class Config>
+NeighborLink* LoRaMeshT<Config>::getOrCreateNeighbor(uint8_t address) {
+    NeighborLink* link = findNeighbor(address);
+    if (link) {
+        return link;
+    }
+    
+    int slot = -1;
+    uint16_t oldestAge = 0;
+    for (int i = 0; i < _neighborTable.size; i++) {
+        if (!_neighborTable[i].valid) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || _neighborTable[i].lastSeenAge > oldestAge) {
+            oldestAge = _neighborTable[i].lastSeenAge;
+            slot = i;
+        }
+    }
+    
+    // New links start at the base settings and are assumed healthy
+    link = &_neighborTable[slot];
+    link->address = address;
+    link->txPower = _txPower;
+    link->codingRate = _codingRate;
+    link->reportedSnr = 0;
+    link->ackHistory = 0xFF;
+    link->valid = 1;
+    link->alwaysOn = 0;
+    link->lastSeenAge = 0;
+    link->wakeTime = 0;
+    link->pacing = 0;
+    link->lastSendTime = 0;
+    return link;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::applyLinkSettings(uint8_t nextHop) {
+    int8_t power = _txPower;
+    uint8_t codingRate = _codingRate;
+    
+    if (adrActive() && nextHop != LORAMESH_BROADCAST_ADDRESS) {
+        NeighborLink* link = findNeighbor(nextHop);
+        if (link) {
+            power = link->txPower;
+            codingRate = link->codingRate;
+        }
+    }
+    
+    // Only touch the radio registers when the settings actually change
+    if (power != _activeTxPower) {
+        _radio->setTxPower(power);
+        _activeTxPower = power;
+    }
+    if (codingRate != _activeCodingRate) {
+        _radio->setCodingRate4(codingRate);
+        _activeCodingRate = codingRate;
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::updateLinkAdr(uint8_t address, bool acked) {
+    NeighborLink* link = getOrCreateNeighbor(address);
+    link->ackHistory = (link->ackHistory << 1) | (acked ? 1 : 0);
+    link->lastSeenAge = 0;
+    
+    uint8_t delivered = 0;
+    for (uint8_t bits = link->ackHistory; bits; bits >>= 1) {
+        delivered += bits & 1;
+    }
+    
+    if (!acked || delivered < LORAMESH_ADR_TARGET_DELIVERY) {
+        // Below target delivery ratio - trade energy for robustness
+        if (link->txPower < LORAMESH_ADR_MAX_TX_POWER) {
+            link->txPower = min(link->txPower + LORAMESH_ADR_POWER_STEP, LORAMESH_ADR_MAX_TX_POWER);
+        } else if (link->codingRate < 8) {
+            link->codingRate++;
+        }
+    } else if (link->codingRate > getPreferredCodingRate(link->reportedSnr)) {
+        // Target met again - shed redundancy the receiver no longer asks for
+        link->codingRate--;
+    } else if (link->reportedSnr - getRequiredSnr() > LORAMESH_ADR_SNR_MARGIN + LORAMESH_ADR_POWER_STEP &&
+               link->txPower > LORAMESH_ADR_MIN_TX_POWER) {
+        // Enough margin left after one step down - save energy
+        link->txPower = max(link->txPower - LORAMESH_ADR_POWER_STEP, LORAMESH_ADR_MIN_TX_POWER);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleAdrReport(uint8_t address, int8_t snr, uint8_t preferredCodingRate) {
+    NeighborLink* link = getOrCreateNeighbor(address);
+    link->reportedSnr = snr;
+    
+    // The receiver's preference is a floor; updateLinkAdr() alone steps back down
+    if (preferredCodingRate <= 8 && preferredCodingRate > link->codingRate) {
+        link->codingRate = preferredCodingRate;
+    }
+    link->lastSeenAge = 0;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getPreferredCodingRate(int8_t snr) {
+    // Spend redundancy only when the link margin runs short
+    int excess = snr - getRequiredSnr() - LORAMESH_ADR_SNR_MARGIN;
+    if (excess >= 0) return 5;
+    if (excess >= -2) return 6;
+    if (excess >= -4) return 7;
+    return 8;
+}
+
+template <class Config>
+int8_t LoRaMeshT<Config>::getRequiredSnr() {
+    // Demodulation floor: -7.5 dB at SF7, 2.5 dB lower per SF step
+    return -(15 + 5 * (_spreadingFactor - 7)) / 2;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getAirtime(uint8_t frameLen, uint8_t codingRate) {
+    // Semtech time-on-air formula (explicit header, CRC, 8 symbol preamble), in microseconds
+    unsigned long symbolTime = (1000000UL << _spreadingFactor) / _signalBandwidth;
+    long lowDataRate = symbolTime > 16000 ? 2 : 0;
+    long numerator = 8L * frameLen - 4L * _spreadingFactor + 28 + 16;
+    long denominator = 4L * (_spreadingFactor - lowDataRate);
+    long payloadSymbols = 8;
+    if (numerator > 0) {
+        payloadSymbols += ((numerator + denominator - 1) / denominator) * codingRate;
+    }
+    // Preamble is the programmed symbols plus 4.25 sync symbols
+    return symbolTime * payloadSymbols + symbolTime * _activePreambleLength + (symbolTime * 17) / 4;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setLowPowerListen(uint16_t wakeInterval, bool sleepRadio) {
+    accountRadioTime();
+    _lplInterval = wakeInterval;
+    _lplSleep = sleepRadio;
+    _lplLastWake = millis();
+    
+    if (_lplInterval == 0 || !_lplSleep) {
+        _radioAsleep = 0;
+    }
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getListenTime() {
+    accountRadioTime();
+    return _listenTime;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getSleepTime() {
+    accountRadioTime();
+    return _sleepTime;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getDeliveredMessages() {
+    return _deliveredMessages;
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getEnergyPerDeliveredMessage() {
+    if (_deliveredMessages == 0) {
+        return 0;
+    }
+    accountRadioTime();
+    
+    // mA * V = mW and mW * ms = uJ
+    float energy = _txEnergy;
+    energy += (float)_listenTime * LORAMESH_RX_CURRENT_UA * LORAMESH_SUPPLY_VOLTAGE_MV / 1000000.0;
+    energy += (float)_sleepTime * LORAMESH_SLEEP_CURRENT_UA * LORAMESH_SUPPLY_VOLTAGE_MV / 1000000.0;
+    return (unsigned long)(energy / _deliveredMessages);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::processLowPowerListen() {
+    if (millis() - _lplLastWake < _lplInterval) {
+        // Between wake windows - make sure the radio is asleep
+        if (!_radioAsleep) {
+            sleepRadio();
+        }
+        return;
+    }
+    
+    accountRadioTime();
+    _radioAsleep = 0;
+    
+    // Stay on the schedule neighbors predict from our wake reports; a late
+    // process() call skips the windows it missed instead of shifting them
+    unsigned long late = millis() - _lplLastWake;
+    _lplLastWake += late - late % _lplInterval;
+    
+    if (sampleChannel()) {
+        // A sender's preamble spans at most one wake interval; wait for its frame
+        unsigned long listenStart = millis();
+        unsigned long listenWindow = _lplInterval + getAirtime(LORAMESH_MAX_MESSAGE_LEN, 8) / 1000;
+        while (millis() - listenStart < listenWindow) {
+            if (receivePacket()) {
+                break;
+            }
+        }
+    }
+    
+    sleepRadio();
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::sampleChannel() {
+    if (_radio != &LoRa) {
+        // No CAD interrupt for this radio: look for preamble energy instead
+        _radio->receive();
+        for (uint8_t i = 0; i < LORAMESH_LPL_RSSI_SAMPLES; i++) {
+            delay(1);
+            if (_radio->rssi() > LORAMESH_LPL_RSSI_THRESHOLD) {
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    LoRaMeshCad::result = 0;
+    _radio->onCadDone(LoRaMeshCad::onDone);
+    _radio->channelActivityDetection();
+    
+    unsigned long cadStart = millis();
+    while (LoRaMeshCad::result == 0 && millis() - cadStart < LORAMESH_LPL_CAD_TIMEOUT) {
+    }
+    
+    // Detach so polled receive keeps seeing its own IRQ flags
+    _radio->onCadDone(NULL);
+    return LoRaMeshCad::result == 2;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sleepRadio() {
+    accountRadioTime();
+    _radio->sleep();
+    _radioAsleep = 1;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::accountRadioTime() {
+    unsigned long now = millis();
+    if (_radioStarted) {
+        if (_radioAsleep) {
+            _sleepTime += now - _radioTimeMark;
+        } else {
+            _listenTime += now - _radioTimeMark;
+        }
+    }
+    _radioTimeMark = now;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::applyWakeTiming(uint8_t nextHop, uint8_t messageType) {
+    uint16_t preambleLength = 8;
+    
+    if (lplActive() && messageType != MESSAGE_TYPE_ACK) {
+        // The ACK receiver is still awake waiting for it; anything else may find
+        // the neighbor asleep, so cover its whole wake interval by default
+        unsigned long symbolTime = (1000000UL << _spreadingFactor) / _signalBandwidth;
+        unsigned long coverTime = (unsigned long)_lplInterval * 1000;
+        
+        NeighborLink* link = NULL;
+        if (nextHop != LORAMESH_BROADCAST_ADDRESS) {
+            link = findNeighbor(nextHop);
+        }
+        
+        if (link && link->alwaysOn) {
+            coverTime = 0;
+        } else if (link && link->wakeTime != 0) {
+            // Learned wake time: transmit just before the neighbor's next window,
+            // widening the guard by 100 ppm of clock drift since we learned it
+            long sinceWake = (long)(millis() - link->wakeTime);
+            unsigned long guard = LORAMESH_LPL_GUARD_TIME;
+            unsigned long untilWake;
+            if (sinceWake < 0) {
+                untilWake = -sinceWake;
+            } else {
+                guard += sinceWake / 10000;
+                untilWake = (_lplInterval - sinceWake % _lplInterval) % _lplInterval;
+            }
+            if (untilWake > guard && guard * 2 < _lplInterval) {
+                delay(untilWake - guard);
+                coverTime = (guard * 2 + LORAMESH_LPL_CAD_TIMEOUT) * 1000;
+            }
+        }
+        
+        unsigned long symbols = coverTime / symbolTime + 8;
+        preambleLength = min(symbols, 65535UL);
+    }
+    
+    if (preambleLength != _activePreambleLength) {
+        _radio->setPreambleLength(preambleLength);
+        _activePreambleLength = preambleLength;
+    }
+}
+
+template <class Config>
+uint16_t LoRaMeshT<Config>::getNextWakeDelay() {
+    unsigned long elapsed = millis() - _lplLastWake;
+    if (elapsed >= _lplInterval) {
+        return 0;
+    }
+    return _lplInterval - elapsed;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleWakeReport(uint8_t address, uint16_t wakeDelay) {
+    NeighborLink* link = getOrCreateNeighbor(address);
+    link->alwaysOn = (wakeDelay == LORAMESH_LPL_UNKNOWN_WAKE);
+    link->wakeTime = link->alwaysOn ? 0 : millis() + wakeDelay;
+    
+    // 0 is reserved for "unknown"
+    if (!link->alwaysOn && link->wakeTime == 0) {
+        link->wakeTime = 1;
+    }
+    link->lastSeenAge = 0;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::addToMessageBuffer(Header& header, uint8_t* data, uint8_t len) {
+    // Add to circular buffer
+    _rxBuffer[_rxBufferHead].header = header;
+    _rxBuffer[_rxBufferHead].dataLen = len;
+    memcpy(_rxBuffer[_rxBufferHead].data, data, len);
+    _rxBuffer[_rxBufferHead].valid = 1;
+    _rxBuffer[_rxBufferHead].timestampAge = 0;
+    
+    _rxBufferHead = (_rxBufferHead + 1) % Config::messageBufferSize;
+    
+    // If buffer is full, advance tail
+    if (_rxBufferHead == _rxBufferTail) {
+        _rxBufferTail = (_rxBufferTail + 1) % Config::messageBufferSize;
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::getFromMessageBuffer(uint8_t* buf, uint8_t* len, uint8_t* source, uint8_t* dest, uint8_t* id) {
+    // Find the oldest valid DATA message
+    while (_rxBufferTail != _rxBufferHead) {
+        if (_rxBuffer[_rxBufferTail].valid && 
+            _rxBuffer[_rxBufferTail].header.messageType == MESSAGE_TYPE_DATA) {
+            
+            if (len) {
+                *len = min(*len, _rxBuffer[_rxBufferTail].dataLen);
+                memcpy(buf, _rxBuffer[_rxBufferTail].data, *len);
+            }
+            
+            if (source) *source = _rxBuffer[_rxBufferTail].header.source;
+            if (dest) *dest = _rxBuffer[_rxBufferTail].header.destination;
+            if (id) *id = _rxBuffer[_rxBufferTail].header.messageId;
+            
+            _rxBuffer[_rxBufferTail].valid = 0;
+            _rxBufferTail = (_rxBufferTail + 1) % Config::messageBufferSize;
+            return true;
+        }
+        _rxBufferTail = (_rxBufferTail + 1) % Config::messageBufferSize;
+    }
+    return false;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::addToPendingQueue(uint8_t destination, const uint8_t* data, uint8_t len, uint8_t messageId) {
+    for (int i = 0; i < Config::pendingQueueSize; i++) {
+        if (!_pendingQueue[i].valid) {
+            _pendingQueue[i].header.destination = destination;
+            _pendingQueue[i].dataLen = len;
+            memcpy(_pendingQueue[i].data, data, len);
+            _pendingQueue[i].header.messageId = messageId;
+            _pendingQueue[i].valid = 1;
+            _pendingQueue[i].relayed = 0;
+            _pendingQueue[i].queuedTime = millis();
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::processPendingMessages() {
+    
+    for (int i = 0; i < Config::pendingQueueSize; i++) {
+        if (_pendingQueue[i].valid && _pendingQueue[i].relayed) {
+            // Relayed frames are not held past the forward timeout; congestion
+            // downstream must not stall this queue for good
+            if (millis() - _pendingQueue[i].queuedTime >= LORAMESH_FORWARD_TIMEOUT) {
+                traceEvent(TRACE_DROP, _pendingQueue[i].header, LORAMESH_BROADCAST_ADDRESS, TRACE_DROP_CONGESTED);
+                _pendingQueue[i].valid = 0;
+                continue;
+            }
+            
+            // A paced next hop is retried on a later call, without blocking
+            Header header = _pendingQueue[i].header;
+            uint8_t nextHop;
+            if (getNextHop(header, nextHop) && isPaced(nextHop)) {
+                continue;
+            }
+            
+            // A refusal leaves the frame queued for another attempt
+            bool sent = sendPacketWithAck(header, _pendingQueue[i].data, _pendingQueue[i].dataLen);
+            if (sent || _ackTracker.congestion != LORAMESH_CONGESTION_FULL) {
+                _pendingQueue[i].valid = 0;
+            }
+        } else if (_pendingQueue[i].valid) {
+            // Give up after 3x discovery timeout; the failure lets sendToWait return
+            if (millis() - _pendingQueue[i].queuedTime >= LORAMESH_ROUTE_DISCOVERY_TIMEOUT * 3UL) {
+                _pendingQueue[i].valid = 0;
+                OutstandingSend* send = findOutstandingSend(_pendingQueue[i].header.messageId);
+                if (send && send->state == DELIVERY_PENDING &&
+                    send->destination == _pendingQueue[i].header.destination) {
+                    send->state = DELIVERY_FAILED;
+                }
+                continue;
+            }
+            
+            // Check if we now have a route
+            RoutingEntry* route = findRoute(_pendingQueue[i].header.destination);
+            if ((route && route->state == ROUTE_STATE_VALID) ||
+                (sourceRoutingActive() && findSourceRoute(_pendingQueue[i].header.destination))) {
+                Header header;
+                header.destination = _pendingQueue[i].header.destination;
+                header.source = _address;
+                header.messageId = _pendingQueue[i].header.messageId;
+                header.messageType = MESSAGE_TYPE_DATA;
+                header.flags = 0;
+                header.hopCount = 0;
+                header.visitedCount = 0;
+                
+                if (receiptsActive()) {
+                    header.flags |= MESSAGE_FLAG_RECEIPT;
+                }
+                applySourceRoute(header, _pendingQueue[i].dataLen);
+                
+                bool sent = sendPacketWithAck(header, _pendingQueue[i].data, _pendingQueue[i].dataLen);
+                _pendingQueue[i].valid = 0;
+                
+                OutstandingSend* send = findOutstandingSend(header.messageId);
+                if (send && send->state == DELIVERY_PENDING) {
+                    send->state = sent ? DELIVERY_FORWARDED : DELIVERY_FAILED;
+                }
+            } else if (!route || route->state == ROUTE_STATE_INVALID) {
+                // No route or invalid route - retry discovery if not active
+                if (!_routeDiscovery.active || 
+                    (_routeDiscovery.destination != _pendingQueue[i].header.destination &&
+                     isAgeExpired(_routeDiscovery.startTimeAge, LORAMESH_ROUTE_DISCOVERY_TIMEOUT / 1000))) {
+                    startRouteDiscovery(_pendingQueue[i].header.destination);
+                }
+            }
+        }
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::extractRoutesFromPath(Header& header, bool isRequest) {
+    // For route requests: learn reverse routes (back to source)
+    // For route replies: learn forward routes (to all nodes in path)
+    
+    if (header.visitedCount == 0) return;
+    
+    if (isRequest) {
+        // Route request: learn routes back to source through visited nodes
+        uint8_t hopCount = 1;
+        
+        // Find our position in the visited nodes (if we're already there)
+        int ourPosition = -1;
+        for (int i = 0; i < header.visitedCount; i++) {
+            if (header.visitedNodes[i] == _address) {
+                ourPosition = i;
+                break;
+            }
+        }
+        
+        // If we're not in the list yet, we're at the end
+        if (ourPosition == -1) {
+            ourPosition = header.visitedCount;
+        }
+        
+        // Learn route to source
+        if (ourPosition > 0) {
+            uint8_t nextHop = header.visitedNodes[ourPosition - 1];
+            updateRoutingTable(header.source, nextHop, ourPosition);
+        } else {
+            // We're the first hop from source
+            updateRoutingTable(header.source, header.source, 1);
+        }
+        
+        // Learn routes to all intermediate nodes
+        for (int i = 0; i < ourPosition; i++) {
+            if (i > 0) {
+                updateRoutingTable(header.visitedNodes[i], header.visitedNodes[ourPosition - 1], ourPosition - i);
+            }
+        }
+    } else {
+        // Route reply: learn routes forward through the path
+        // Find our position in the path
+        int ourPosition = -1;
+        for (int i = 0; i < header.visitedCount; i++) {
+            if (header.visitedNodes[i] == _address) {
+                ourPosition = i;
+                break;
+            }
+        }
+        
+        if (ourPosition >= 0) {
+            // Learn routes to all nodes after us in the path
+            for (int i = ourPosition + 1; i < header.visitedCount; i++) {
+                uint8_t nextHop = (ourPosition + 1 < header.visitedCount) ? 
+                                  header.visitedNodes[ourPosition + 1] : header.source;
+                updateRoutingTable(header.visitedNodes[i], nextHop, i - ourPosition);
+            }
+            
+            // Learn route to the reply source (original destination)
+            if (ourPosition + 1 < header.visitedCount) {
+                updateRoutingTable(header.source, header.visitedNodes[ourPosition + 1], 
+                                 header.visitedCount - ourPosition);
+            } else {
+                updateRoutingTable(header.source, header.source, 1);
+            }
+        }
+    }
+}
+
+// Helper functions for age-based timestamp system
+template <class Config>
+uint16_t LoRaMeshT<Config>::getAgeFromTime(unsigned long timestamp) {
+    unsigned long currentTime = millis();
+    if (currentTime >= timestamp) {
+        return min((currentTime - timestamp) / 1000, 65535UL);
+    }
+    // Handle rollover case
+    return min(((0xFFFFFFFF - timestamp) + currentTime) / 1000, 65535UL);
+}
+
+template <class Config>
+unsigned long LoRaMeshT<Config>::getTimeFromAge(uint16_t age) {
+    unsigned long currentTime = millis();
+    unsigned long ageMs = (unsigned long)age * 1000;
+    if (currentTime >= ageMs) {
+        return currentTime - ageMs;
+    }
+    // Handle rollover case
+    return (0xFFFFFFFF - ageMs) + currentTime;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::isAgeExpired(uint16_t age, uint16_t timeoutSeconds) {
+    return age >= timeoutSeconds;
+}
+template <class Config>
+bool LoRaMeshT<Config>::setNetworkKey(const uint8_t* key) {
+    if (!key) {
+        _secureMode = 0;
+        return true;
+    }
+    
+    // A frame counter restarting at 0 after a reset would repeat nonces under this key
+    if (!Config::security || !persistActive()) {
+        return false;
+    }
+    _networkCipher->setKey(key);
+    _secureMode = 1;
+    return true;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::setLinkKey(uint8_t neighbor, const uint8_t* key) {
+    int slot = -1;
+    for (int i = 0; i < _linkKeys.size; i++) {
+        if (_linkKeys[i].valid && _linkKeys[i].neighbor == neighbor) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && !_linkKeys[i].valid) {
+            slot = i;
+        }
+    }
+    
+    if (!key) {
+        if (slot >= 0 && _linkKeys[slot].neighbor == neighbor) {
+            _linkKeys[slot].valid = 0;
+        }
+        return true;
+    }
+    
+    if (slot < 0) {
+        return false;
+    }
+    
+    _linkKeys[slot].neighbor = neighbor;
+    _linkKeys[slot].cipher.setKey(key);
+    _linkKeys[slot].valid = 1;
+    return true;
+}
+
+template <class Config>
+LoRaMeshCipher* LoRaMeshT<Config>::getCipher(uint8_t neighbor) {
+    for (int i = 0; i < _linkKeys.size; i++) {
+        if (_linkKeys[i].valid && _linkKeys[i].neighbor == neighbor) {
+            return &_linkKeys[i].cipher;
+        }
+    }
+    return _networkCipher.data();
+}
+
+template <class Config>
+void LoRaMeshT<Config>::buildNonce(uint8_t* nonce, const uint8_t* frame, uint8_t transmitter, uint32_t counter) {
+    // Unique per key as long as each transmitter never repeats a counter value
+    memset(nonce, 0, LORAMESH_NONCE_LEN);
+    nonce[0] = transmitter;
+    nonce[1] = frame[1];    // Source
+    nonce[2] = frame[2];    // Message ID
+    nonce[3] = counter >> 24;
+    nonce[4] = counter >> 16;
+    nonce[5] = counter >> 8;
+    nonce[6] = counter;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::sealFrame(uint8_t* frame, uint8_t headerLen, uint8_t len, uint8_t nextHop) {
+    // A counter reused under the same key after a reset would repeat a nonce
+    if (persistActive() && _frameCounter >= _frameCounterLease) {
+        persistCounters();
+    }
+    uint32_t counter = _frameCounter++;
+    
+    // Relays rewrite hop fields, so each hop seals the frame again with its own counter
+    frame[3] |= MESSAGE_FLAG_SECURE;
+    
+    uint8_t* trailer = &frame[headerLen + len];
+    trailer[0] = _address;
+    trailer[1] = counter;
+    trailer[2] = counter >> 8;
+    trailer[3] = counter >> 16;
+    trailer[4] = counter >> 24;
+    
+    uint8_t nonce[LORAMESH_NONCE_LEN];
+    buildNonce(nonce, frame, _address, counter);
+    
+    LoRaMeshCipher* cipher = (nextHop == LORAMESH_BROADCAST_ADDRESS) ? _networkCipher.data() : getCipher(nextHop);
+    cipher->seal(nonce, frame, headerLen, &frame[headerLen], len, &trailer[5]);
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::openFrame(uint8_t* frame, uint8_t frameLen) {
+    // Structural checks first so malformed frames cost no cipher work
+    if (frameLen < 8 + LORAMESH_SECURE_OVERHEAD) return false;
+    
+    uint8_t visitedCount = frame[5];
+    if (visitedCount > Config::maxHops) return false;
+    
+    uint8_t headerLen = 8 + visitedCount;
+    if (headerLen + LORAMESH_SECURE_OVERHEAD > frameLen) return false;
+    
+    uint8_t len = frame[headerLen - 1];
+    if (headerLen + len + LORAMESH_SECURE_OVERHEAD != frameLen) return false;
+    
+    uint8_t* trailer = &frame[headerLen + len];
+    uint8_t transmitter = trailer[0];
+    if (transmitter == _address) return false;
+    
+    uint32_t counter = trailer[1] | ((uint32_t)trailer[2] << 8) |
+                       ((uint32_t)trailer[3] << 16) | ((uint32_t)trailer[4] << 24);
+    
+    uint8_t nonce[LORAMESH_NONCE_LEN];
+    buildNonce(nonce, frame, transmitter, counter);
+    
+    uint8_t nextHop = frame[headerLen - 2];
+    LoRaMeshCipher* cipher = (nextHop == LORAMESH_BROADCAST_ADDRESS) ? _networkCipher.data() : getCipher(transmitter);
+    if (!cipher->open(nonce, frame, headerLen, &frame[headerLen], len, &trailer[5])) {
+        return false;
+    }
+    
+    // Only authenticated counters may advance the window
+    return !isReplayedFrame(transmitter, counter);
+}
+
+template <class Config>
+ReplayEntry* LoRaMeshT<Config>::getReplayEntry(uint8_t address) {
+    // Lookup only; callers refresh lastSeen for accepted IDs and frames alone
+    int slot = -1;
+    unsigned long oldestAge = 0;
+    for (int i = 0; i < Config::replayTableSize; i++) {
+        if (_replayTable[i].valid && _replayTable[i].address == address) {
+            return &_replayTable[i];
+        }
+    }
+    
+    // Least recently active source makes room
+    for (int i = 0; i < Config::replayTableSize; i++) {
+        if (!_replayTable[i].valid) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 || millis() - _replayTable[i].lastSeen > oldestAge) {
+            oldestAge = millis() - _replayTable[i].lastSeen;
+            slot = i;
+        }
+    }
+    
+    ReplayEntry* entry = &_replayTable[slot];
+    entry->address = address;
+    entry->valid = 1;
+    entry->messageValid = 0;
+    entry->messageHighest = 0;
+    entry->frameValid = 0;
+    entry->lastSeen = millis();
+    return entry;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::checkReplayWindow(uint32_t& highest, uint32_t& bitmap, int32_t delta) {
+    if (delta > 0) {
+        // Newer than anything seen - slide the window forward
+        bitmap = (delta >= LORAMESH_REPLAY_WINDOW) ? 0 : (bitmap << delta);
+        bitmap |= 1;
+        highest += delta;
+        return true;
+    }
+    
+    uint32_t offset = -delta;
+    if (offset >= LORAMESH_REPLAY_WINDOW) {
+        return false;
+    }
+    if (bitmap & (1UL << offset)) {
+        return false;
+    }
+    bitmap |= 1UL << offset;
+    return true;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::isDuplicateMessage(uint8_t source, uint8_t messageId) {
+    ReplayEntry* entry = getReplayEntry(source);
+    
+    // Duplicates are retries and flood copies, which arrive within seconds; a
+    // source quiet for longer may have restarted its sequence
+    if (entry->messageValid && millis() - entry->lastSeen >= LORAMESH_DUPLICATE_TIMEOUT) {
+        entry->messageValid = 0;
+    }
+    
+    // Extend the 8-bit ID to the sequence number closest to the highest seen
+    int8_t delta = (int8_t)(messageId - (uint8_t)entry->messageHighest);
+    if (!entry->messageValid || delta <= -LORAMESH_REPLAY_WINDOW) {
+        // All of a source's traffic shares one sequence, so a receiver that sees
+        // only part of it sees large jumps: an ID outside the window is new
+        entry->messageHighest += (uint8_t)delta;
+        entry->messageBitmap = 1;
+        entry->messageValid = 1;
+    } else if (!checkReplayWindow(entry->messageHighest, entry->messageBitmap, delta)) {
+        // Only an ID already marked in the window is a duplicate
+        return true;
+    }
+    entry->lastSeen = millis();
+    return false;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::isReplayedFrame(uint8_t transmitter, uint32_t counter) {
+    ReplayEntry* entry = getReplayEntry(transmitter);
+    
+    if (!entry->frameValid) {
+        entry->frameHighest = counter;
+        entry->frameBitmap = 1;
+        entry->frameValid = 1;
+    } else if (!checkReplayWindow(entry->frameHighest, entry->frameBitmap,
+                                  (int32_t)(counter - entry->frameHighest))) {
+        // Counters persist across resets (see setNetworkKey), so the window
+        // never needs to move back; rejected frames leave it untouched
+        return true;
+    }
+    entry->lastSeen = millis();
+    return false;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setDeliveryReceipts(bool enabled) {
+    _receiptsEnabled = enabled;
+}
+
+template <class Config>
+DeliveryState LoRaMeshT<Config>::getDeliveryState(uint8_t messageId, unsigned long* latency) {
+    OutstandingSend* send = findOutstandingSend(messageId);
+    if (!send) {
+        return DELIVERY_NONE;
+    }
+    if (latency) {
+        *latency = send->latency;
+    }
+    return (DeliveryState)send->state;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getLastMessageId() {
+    return _lastMessageId;
+}
+
+template <class Config>
+OutstandingSend* LoRaMeshT<Config>::addOutstandingSend(uint8_t destination, uint8_t messageId) {
+    // Reuse a free slot, otherwise the oldest entry
+    int slot = 0;
+    for (int i = 0; i < Config::outstandingTableSize; i++) {
+        if (_outstandingTable[i].state == DELIVERY_NONE) {
+            slot = i;
+            break;
+        }
+        if (_outstandingTable[i].sendTime - _outstandingTable[slot].sendTime > 0x7FFFFFFFUL) {
+            slot = i;
+        }
+    }
+    
+    OutstandingSend* send = &_outstandingTable[slot];
+    send->destination = destination;
+    send->messageId = messageId;
+    send->state = DELIVERY_PENDING;
+    send->sendTime = millis();
+    send->latency = 0;
+    return send;
+}
+
+template <class Config>
+OutstandingSend* LoRaMeshT<Config>::findOutstandingSend(uint8_t messageId) {
+    for (int i = 0; i < Config::outstandingTableSize; i++) {
+        if (_outstandingTable[i].state != DELIVERY_NONE &&
+            _outstandingTable[i].messageId == messageId) {
+            return &_outstandingTable[i];
+        }
+    }
+    return NULL;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::removeFromPendingQueue(uint8_t destination, uint8_t messageId) {
+    for (int i = 0; i < Config::pendingQueueSize; i++) {
+        if (_pendingQueue[i].valid && !_pendingQueue[i].relayed &&
+            _pendingQueue[i].header.destination == destination &&
+            _pendingQueue[i].header.messageId == messageId) {
+            _pendingQueue[i].valid = 0;
+        }
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::queueForward(Header& header, const uint8_t* data, uint8_t len) {
+    for (int i = 0; i < Config::pendingQueueSize; i++) {
+        if (!_pendingQueue[i].valid) {
+            _pendingQueue[i].header = header;
+            _pendingQueue[i].dataLen = len;
+            memcpy(_pendingQueue[i].data, data, len);
+            _pendingQueue[i].valid = 1;
+            _pendingQueue[i].relayed = 1;
+            _pendingQueue[i].queuedTime = millis();
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class Config>
+uint8_t LoRaMeshT<Config>::getCongestion(bool relay) {
+    // Relays hold frames in the pending queue, destinations in the receive
+    // ring, which always keeps one slot free
+    uint8_t used = 0;
+    uint8_t capacity;
+    if (relay) {
+        for (int i = 0; i < Config::pendingQueueSize; i++) {
+            used += _pendingQueue[i].valid;
+        }
+        capacity = Config::pendingQueueSize;
+    } else {
+        used = (_rxBufferHead + Config::messageBufferSize - _rxBufferTail) % Config::messageBufferSize;
+        capacity = Config::messageBufferSize - 1;
+    }
+    
+    if (capacity == 0) {
+        return LORAMESH_CONGESTION_NONE;
+    }
+    if (used >= capacity) {
+        return LORAMESH_CONGESTION_FULL;
+    }
+    if (used > 0 && used * 2 >= capacity) {
+        return LORAMESH_CONGESTION_BUSY;
+    }
+    return LORAMESH_CONGESTION_NONE;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::handleCongestionReport(uint8_t address, uint8_t congestion) {
+    if (congestion == LORAMESH_CONGESTION_NONE) {
+        // Recover additively, one clean ACK at a time
+        NeighborLink* link = findNeighbor(address);
+        if (link) {
+            link->pacing = link->pacing > LORAMESH_PACING_RECOVERY ? link->pacing - LORAMESH_PACING_RECOVERY : 0;
+        }
+        return;
+    }
+    
+    // Back off multiplicatively; the gap counts from this report
+    NeighborLink* link = getOrCreateNeighbor(address);
+    if (link->pacing == 0) {
+        link->pacing = LORAMESH_PACING_MIN;
+    } else {
+        link->pacing = link->pacing >= LORAMESH_PACING_MAX / 2 ? LORAMESH_PACING_MAX : link->pacing * 2;
+    }
+    link->lastSendTime = millis();
+    link->lastSeenAge = 0;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::waitForPacing(uint8_t nextHop) {
+    NeighborLink* link = findNeighbor(nextHop);
+    if (!link) {
+        return;
+    }
+    
+    // Keep receiving meanwhile, as while waiting for an ACK
+    while (link->valid && link->address == nextHop && millis() - link->lastSendTime < link->pacing) {
+        if (_bridge) {
+            _bridge->poll(this);
+        }
+        receivePacket();
+        delay(10);
+    }
+    if (link->valid && link->address == nextHop) {
+        link->lastSendTime = millis();
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::isPaced(uint8_t nextHop) {
+    NeighborLink* link = findNeighbor(nextHop);
+    return link && millis() - link->lastSendTime < link->pacing;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::queueReceipt(uint8_t destination, uint8_t messageId) {
+    if (!Config::deliveryReceipts) {
+        return;
+    }
+    
+    // Aggregate receipts per originator so one frame confirms several messages
+    int slot = -1;
+    for (int i = 0; i < _receiptQueue.size; i++) {
+        if (_receiptQueue[i].count > 0 && _receiptQueue[i].destination == destination) {
+            slot = i;
+            break;
+        }
+        if (slot < 0 && _receiptQueue[i].count == 0) {
+            slot = i;
+        }
+    }
+    
+    if (slot < 0) {
+        // All slots busy - flush the first one to make room
+        flushReceipts(0);
+        slot = 0;
+    }
+    
+    if (_receiptQueue[slot].count == 0) {
+        _receiptQueue[slot].destination = destination;
+        _receiptQueue[slot].firstTime = millis();
+    }
+    
+    uint8_t count = _receiptQueue[slot].count;
+    _receiptQueue[slot].messageIds[count] = messageId;
+    _receiptQueue[slot].receiveTimes[count] = millis() - _receiptQueue[slot].firstTime;
+    _receiptQueue[slot].count++;
+    
+    if (_receiptQueue[slot].count == LORAMESH_RECEIPT_BATCH) {
+        flushReceipts(slot);
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::processReceipts() {
+    for (int i = 0; i < _receiptQueue.size; i++) {
+        if (_receiptQueue[i].count > 0 &&
+            millis() - _receiptQueue[i].firstTime >= LORAMESH_RECEIPT_DELAY) {
+            flushReceipts(i);
+        }
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::flushReceipts(uint8_t slot) {
+    uint8_t count = _receiptQueue[slot].count;
+    _receiptQueue[slot].count = 0;
+    
+    uint8_t receiptData[LORAMESH_RECEIPT_BATCH * 2];
+    unsigned long held = millis() - _receiptQueue[slot].firstTime;
+    for (uint8_t i = 0; i < count; i++) {
+        unsigned long messageHeld = (held - _receiptQueue[slot].receiveTimes[i]) / 10;
+        receiptData[i * 2] = _receiptQueue[slot].messageIds[i];
+        receiptData[i * 2 + 1] = min(messageHeld, 255UL);
+    }
+    
+    Header header;
+    header.destination = _receiptQueue[slot].destination;
+    header.source = _address;
+    header.messageId = getNextMessageId();
+    header.messageType = MESSAGE_TYPE_RECEIPT;
+    header.flags = 0;
+    header.hopCount = 0;
+    header.visitedCount = 0;
+    applySourceRoute(header, count * 2);
+    
+    sendPacketWithAck(header, receiptData, count * 2);
+}
+
+template <class Config>
+void LoRaMeshT<Config>::setPersistence(LoRaMeshStorageRead read, LoRaMeshStorageWrite write,
+                                       uint16_t baseAddress, LoRaMeshStorageCommit commit) {
+    _storageRead = read;
+    _storageWrite = (read != NULL) ? write : NULL;
+    _storageCommit = commit;
+    _storageBase = baseAddress;
+    _snapshotCursor = 0;
+    _snapshotTime = millis();
+    
+    // Attached after begin(): merge or claim the snapshot right away
+    if (_radioStarted && persistActive()) {
+        restoreSnapshot();
+    }
+}
+
+template <class Config>
+uint16_t LoRaMeshT<Config>::getSnapshotSize() {
+    return LORAMESH_SNAPSHOT_HEADER_LEN +
+           Config::routingTableSize * LORAMESH_SNAPSHOT_ROUTE_LEN +
+           _neighborTable.size * LORAMESH_SNAPSHOT_NEIGHBOR_LEN;
+}
+
+template <class Config>
+void LoRaMeshT<Config>::restoreSnapshot() {
+    // Every value below a stored lease may have gone out before the reset. The
+    // header layout is shared by all snapshot versions, so counters survive a
+    // version or table size change
+    bool owned = _storageRead(_storageBase) == LORAMESH_SNAPSHOT_MAGIC &&
+                 _storageRead(_storageBase + 4) == _address;
+    if (owned) {
+        uint32_t sequence = loadCounter(6);
+        uint32_t frameCounter = loadCounter(10);
+        if (sequence > _sequence) _sequence = sequence;
+        if (frameCounter > _frameCounter) _frameCounter = frameCounter;
+    }
+    
+    bool valid = owned &&
+                 _storageRead(_storageBase + 1) == LORAMESH_SNAPSHOT_VERSION &&
+                 _storageRead(_storageBase + 2) == Config::routingTableSize &&
+                 _storageRead(_storageBase + 3) == _neighborTable.size;
+    
+    if (!valid) {
+        // Foreign, empty or outdated storage: claim it, starting from the current counters.
+        // The magic byte goes last so a reset midway leaves no half-valid snapshot
+        storeByte(0, 0);
+        storeByte(1, LORAMESH_SNAPSHOT_VERSION);
+        storeByte(2, Config::routingTableSize);
+        storeByte(3, _neighborTable.size);
+        storeByte(4, _address);
+        for (int i = 0; i < Config::routingTableSize; i++) {
+            storeByte(LORAMESH_SNAPSHOT_HEADER_LEN + i * LORAMESH_SNAPSHOT_ROUTE_LEN + 3, ROUTE_STATE_INVALID);
+        }
+        uint16_t neighbors = LORAMESH_SNAPSHOT_HEADER_LEN + Config::routingTableSize * LORAMESH_SNAPSHOT_ROUTE_LEN;
+        for (int i = 0; i < _neighborTable.size; i++) {
+            storeByte(neighbors + i * LORAMESH_SNAPSHOT_NEIGHBOR_LEN + 3, 0);
+        }
+        persistCounters();
+        storeByte(0, LORAMESH_SNAPSHOT_MAGIC);
+        if (_storageCommit) _storageCommit();
+        return;
+    }
+    persistCounters();
+    
+    // Ages are not stored, and the node may have been off for any time: restored
+    // entries start at a fixed age, so they expire soon unless traffic confirms them
+    uint16_t offset = LORAMESH_SNAPSHOT_HEADER_LEN;
+    for (int i = 0; i < Config::routingTableSize; i++, offset += LORAMESH_SNAPSHOT_ROUTE_LEN) {
+        if (_storageRead(_storageBase + offset + 3) != ROUTE_STATE_VALID) {
+            continue;
+        }
+        _routingTable[i].destination = _storageRead(_storageBase + offset);
+        _routingTable[i].nextHop = _storageRead(_storageBase + offset + 1);
+        _routingTable[i].hopCount = _storageRead(_storageBase + offset + 2);
+        _routingTable[i].state = ROUTE_STATE_VALID;
+        _routingTable[i].lastSeenAge = LORAMESH_SNAPSHOT_RESTORE_AGE;
+    }
+    
+    for (int i = 0; i < _neighborTable.size; i++, offset += LORAMESH_SNAPSHOT_NEIGHBOR_LEN) {
+        uint8_t flags = _storageRead(_storageBase + offset + 3);
+        if (!(flags & 0x01)) {
+            continue;
+        }
+        NeighborLink* link = &_neighborTable[i];
+        link->address = _storageRead(_storageBase + offset);
+        link->txPower = (int8_t)_storageRead(_storageBase + offset + 1);
+        link->codingRate = _storageRead(_storageBase + offset + 2);
+        link->reportedSnr = 0;  // Fast-changing metrics restart as for a new link
+        link->ackHistory = 0xFF;
+        link->valid = 1;
+        link->alwaysOn = (flags >> 1) & 0x01;
+        link->lastSeenAge = LORAMESH_SNAPSHOT_RESTORE_AGE;
+        link->wakeTime = 0;     // millis() restarted, relearned from the next ACK
+        link->pacing = 0;
+        link->lastSendTime = 0;
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::persistSnapshot() {
+    if (_snapshotCursor == 0) {
+        if (millis() - _snapshotTime < LORAMESH_SNAPSHOT_INTERVAL) {
+            return;
+        }
+        _snapshotTime = millis();
+    }
+    
+    // One record per call keeps EEPROM write latency out of the receive path.
+    // Records hold only fields that change with the topology, not ages or
+    // per-frame metrics, and unchanged bytes are never rewritten
+    bool changed = false;
+    if (_snapshotCursor < Config::routingTableSize) {
+        RoutingEntry* route = &_routingTable[_snapshotCursor];
+        uint16_t offset = LORAMESH_SNAPSHOT_HEADER_LEN + _snapshotCursor * LORAMESH_SNAPSHOT_ROUTE_LEN;
+        if (route->state == ROUTE_STATE_VALID) {
+            changed |= storeByte(offset, route->destination);
+            changed |= storeByte(offset + 1, route->nextHop);
+            changed |= storeByte(offset + 2, route->hopCount);
+        }
+        changed |= storeByte(offset + 3, route->state == ROUTE_STATE_VALID ? ROUTE_STATE_VALID : ROUTE_STATE_INVALID);
+    } else {
+        uint8_t index = _snapshotCursor - Config::routingTableSize;
+        NeighborLink* link = &_neighborTable[index];
+        uint16_t offset = LORAMESH_SNAPSHOT_HEADER_LEN +
+                          Config::routingTableSize * LORAMESH_SNAPSHOT_ROUTE_LEN +
+                          index * LORAMESH_SNAPSHOT_NEIGHBOR_LEN;
+        if (link->valid) {
+            changed |= storeByte(offset, link->address);
+            changed |= storeByte(offset + 1, (uint8_t)link->txPower);
+            changed |= storeByte(offset + 2, link->codingRate);
+        }
+        changed |= storeByte(offset + 3, link->valid | (link->alwaysOn << 1));
+    }
+    
+    if (changed && _storageCommit) {
+        _storageCommit();
+    }
+    
+    if (++_snapshotCursor >= Config::routingTableSize + _neighborTable.size) {
+        _snapshotCursor = 0;
+    }
+}
+
+template <class Config>
+void LoRaMeshT<Config>::persistCounters() {
+    // Reserve a block of values per write so the counters cost one storage
+    // update per LORAMESH_SEQUENCE_LEASE frames instead of one per frame
+    if (_sequence >= _sequenceLease) {
+        _sequenceLease = _sequence + LORAMESH_SEQUENCE_LEASE;
+    }
+    if (_frameCounter >= _frameCounterLease) {
+        _frameCounterLease = _frameCounter + LORAMESH_SEQUENCE_LEASE;
+    }
+    
+    bool changed = storeCounter(6, _sequenceLease);
+    changed |= storeCounter(10, _frameCounterLease);
+    if (changed && _storageCommit) {
+        _storageCommit();
+    }
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::storeByte(uint16_t offset, uint8_t value) {
+    uint16_t address = _storageBase + offset;
+    if (_storageRead(address) == value) {
+        return false;
+    }
+    _storageWrite(address, value);
+    return true;
+}
+
+template <class Config>
+uint32_t LoRaMeshT<Config>::loadCounter(uint16_t offset) {
+    uint32_t value = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+        value |= (uint32_t)_storageRead(_storageBase + offset + i) << (8 * i);
+    }
+    return value;
+}
+
+template <class Config>
+bool LoRaMeshT<Config>::storeCounter(uint16_t offset, uint32_t value) {
+    bool changed = false;
+    for (uint8_t i = 0; i < 4; i++) {
+        changed |= storeByte(offset + i, value >> (8 * i));
+    }
+    return changed;
+}
+
+#endif